@@ -0,0 +1,752 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "deque.h"
+#include "deque_algorithm.h"
+#include "deque_async.h"
+#include "deque_channel.h"
+#include "deque_concurrent.h"
+#include "deque_epoch.h"
+#include "deque_parallel.h"
+#include "deque_sharded.h"
+#include "deque_spsc.h"
+#include "deque_task_pool.h"
+#include "deque_work_stealing.h"
+
+using namespace lab;
+
+namespace {
+    volatile std::size_t sink;
+
+    /// @brief Runs fn several times and returns the best time in milliseconds.
+    template <class Fn>
+    double measure(Fn fn, int repeats = 5) {
+        double best = 1e300;
+        for (int i = 0; i < repeats; i++) {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            std::chrono::duration<double, std::milli> time =
+                    std::chrono::steady_clock::now() - start;
+            best = std::min(best, time.count());
+        }
+        return best;
+    }
+
+    void report(const std::string& name, double ms) {
+        std::cout << "  " << name << ": " << ms << " ms\n";
+    }
+
+    template <class T>
+    void bench_find(const char* type_name, std::size_t n) {
+        const T needle = T(127);
+        Deque<T> deq;
+        std::deque<T> std_deq;
+        std::vector<T> vec;
+        for (std::size_t i = 0; i < n; i++) {
+            T value = T(i % 100);
+            deq.push_back(value);
+            std_deq.push_back(value);
+            vec.push_back(value);
+        }
+        deq.push_back(needle);
+        std_deq.push_back(needle);
+        vec.push_back(needle);
+
+        std::cout << "find " << type_name << ", " << n << " elements\n";
+        report("lab::Deque::find", measure([&] { sink = deq.find(needle) - deq.begin(); }));
+        report("std::find on lab::Deque", measure([&] {
+            sink = std::find(deq.begin(), deq.end(), needle) - deq.begin();
+        }));
+        report("std::find on std::deque", measure([&] {
+            sink = std::find(std_deq.begin(), std_deq.end(), needle) - std_deq.begin();
+        }));
+        report("std::find on std::vector", measure([&] {
+            sink = std::find(vec.begin(), vec.end(), needle) - vec.begin();
+        }));
+        report("lab::Deque::count", measure([&] { sink = deq.count(needle); }));
+        report("std::count on std::vector",
+               measure([&] { sink = std::count(vec.begin(), vec.end(), needle); }));
+    }
+
+    void bench_reduce(std::size_t n) {
+        Deque<double> deq;
+        std::vector<double> vec;
+        for (std::size_t i = 0; i < n; i++) {
+            deq.push_back(double(i % 1000) / 7);
+            vec.push_back(double(i % 1000) / 7);
+        }
+        volatile double result;
+
+        std::cout << "reduce double, " << n << " elements\n";
+        report("lab::sum", measure([&] { result = sum(deq); }));
+        report("lab::sum(reassociate)", measure([&] { result = sum(reassociate, deq); }));
+        report("std::accumulate on lab::Deque", measure([&] {
+            result = std::accumulate(deq.begin(), deq.end(), 0.0);
+        }));
+        report("std::accumulate on std::vector", measure([&] {
+            result = std::accumulate(vec.begin(), vec.end(), 0.0);
+        }));
+        report("lab::minmax", measure([&] { result = minmax(deq).second; }));
+        report("std::minmax_element on std::vector", measure([&] {
+            result = *std::minmax_element(vec.begin(), vec.end()).second;
+        }));
+    }
+
+    void bench_parallel_scaling(std::size_t n) {
+        Deque<int> deq(n, 1);
+        volatile long long result;
+
+        std::cout << "parallel reduce / for_each int, " << n << " elements, "
+                  << ThreadPool::instance().size() << " hardware threads\n";
+        for (unsigned threads = 1; threads <= 2 * ThreadPool::instance().size();
+             threads *= 2) {
+            double reduce_ms = measure([&] {
+                result = reduce(par(threads), deq, 0, std::plus<>());
+            });
+            double for_each_ms =
+                    measure([&] { for_each(par(threads), deq, [](int& x) { x ^= 1; }); });
+            report("reduce, " + std::to_string(threads) + " parts", reduce_ms);
+            report("for_each, " + std::to_string(threads) + " parts", for_each_ms);
+        }
+    }
+
+    void bench_sort(std::size_t n) {
+        std::mt19937 rng(1);
+        std::vector<int> input(n);
+        for (auto& x : input) x = int(rng());
+
+        std::cout << "sort int, " << n << " random elements\n";
+        auto run = [&](const std::string& name, auto make, auto sort_fn) {
+            double best = 1e300;
+            for (int i = 0; i < 3; i++) {
+                auto container = make();
+                best = std::min(best, measure([&] { sort_fn(container); }, 1));
+            }
+            report(name, best);
+        };
+        auto make_lab = [&] { return Deque<int>(input.begin(), input.end()); };
+        run("lab::sort", make_lab, [](auto& c) { sort(c); });
+        run("lab::sort(par)", make_lab, [](auto& c) { sort(par, c); });
+        run("std::sort on lab::Deque", make_lab,
+            [](auto& c) { std::sort(c.begin(), c.end()); });
+        run("std::sort on std::deque",
+            [&] { return std::deque<int>(input.begin(), input.end()); },
+            [](auto& c) { std::sort(c.begin(), c.end()); });
+        run("std::sort on std::vector", [&] { return input; },
+            [](auto& c) { std::sort(c.begin(), c.end()); });
+    }
+    void bench_bounds(std::size_t n, std::size_t queries) {
+        Deque<std::int64_t> deq;
+        std::deque<std::int64_t> std_deq;
+        std::vector<std::int64_t> vec;
+        for (std::size_t i = 0; i < n; i++) {
+            deq.push_back(std::int64_t(i) * 3);
+            std_deq.push_back(std::int64_t(i) * 3);
+            vec.push_back(std::int64_t(i) * 3);
+        }
+        std::mt19937_64 rng(1);
+        std::vector<std::int64_t> keys(queries);
+        for (auto& key : keys) key = std::int64_t(rng() % (3 * n));
+        ChunkHeadIndex index(deq);
+
+        std::cout << "lower_bound int64, " << n << " elements, " << queries
+                  << " queries\n";
+        auto run = [&](const std::string& name, auto search) {
+            report(name, measure([&] {
+                std::size_t total = 0;
+                for (auto key : keys) total += search(key);
+                sink = total;
+            }));
+        };
+        run("lab::Deque::lower_bound",
+            [&](std::int64_t key) { return deq.lower_bound(key) - deq.begin(); });
+        run("lab::ChunkHeadIndex::lower_bound",
+            [&](std::int64_t key) { return index.lower_bound(key) - deq.begin(); });
+        run("std::lower_bound on lab::Deque", [&](std::int64_t key) {
+            return std::lower_bound(deq.begin(), deq.end(), key) - deq.begin();
+        });
+        run("std::lower_bound on std::deque", [&](std::int64_t key) {
+            return std::lower_bound(std_deq.begin(), std_deq.end(), key) - std_deq.begin();
+        });
+        run("std::lower_bound on std::vector", [&](std::int64_t key) {
+            return std::lower_bound(vec.begin(), vec.end(), key) - vec.begin();
+        });
+    }
+    void bench_rotate(std::size_t n) {
+        std::cout << "rotate int by n / 3, " << n << " elements\n";
+        for (std::size_t size : {n, n + 1}) {
+            Deque<int> deq(size, 1);
+            std::deque<int> std_deq(size, 1);
+            std::string suffix = size % 128 == 0 ? "" : " (size not a chunk multiple)";
+            report("lab::Deque::rotate" + suffix, measure([&] { deq.rotate(size / 3); }));
+            report("std::rotate on lab::Deque" + suffix, measure([&] {
+                std::rotate(deq.begin(), deq.begin() + size / 3, deq.end());
+            }));
+            report("std::rotate on std::deque" + suffix, measure([&] {
+                std::rotate(std_deq.begin(), std_deq.begin() + size / 3, std_deq.end());
+            }));
+        }
+    }
+    void bench_splice(std::size_t n) {
+        std::cout << "splice_back of two int deques, " << n << " elements each\n";
+        for (std::size_t skew : {0, 1}) {
+            std::string suffix = skew ? " (chunks not aligned)" : "";
+            auto run = [&](const std::string& name, auto join) {
+                double best = 1e300;
+                for (int i = 0; i < 3; i++) {
+                    Deque<int> a(n, 1), b(n + skew, 2);
+                    b.pop_front();
+                    if (!skew) b.push_front(2);
+                    best = std::min(best, measure([&] { join(a, b); }, 1));
+                }
+                report(name + suffix, best);
+            };
+            run("lab::Deque::splice_back",
+                [](Deque<int>& a, Deque<int>& b) { a.splice_back(std::move(b)); });
+            run("push_back loop", [](Deque<int>& a, Deque<int>& b) {
+                for (int& x : b) a.push_back(std::move(x));
+                b.clear();
+            });
+        }
+        double best = 1e300;
+        for (int i = 0; i < 3; i++) {
+            std::deque<int> a(n, 1), b(n, 2);
+            best = std::min(best, measure([&] {
+                a.insert(a.end(), std::make_move_iterator(b.begin()),
+                         std::make_move_iterator(b.end()));
+                b.clear();
+            }, 1));
+        }
+        report("std::deque::insert", best);
+    }
+    void bench_split(std::size_t n) {
+        std::cout << "split int deque into 8 pieces, " << n << " elements\n";
+        auto run = [&](const std::string& name, auto split) {
+            double best = 1e300;
+            for (int i = 0; i < 3; i++) {
+                Deque<int> deq(n, 1);
+                best = std::min(best, measure([&] { sink = split(deq).size(); }, 1));
+            }
+            report(name, best);
+        };
+        run("lab::Deque::split_into", [](Deque<int>& deq) { return deq.split_into(8); });
+        run("copy and erase", [](Deque<int>& deq) {
+            std::vector<Deque<int>> pieces(8);
+            std::size_t piece = deq.size() / 8;
+            for (int i = 7; i >= 0; i--) {
+                auto from = i == 0 ? deq.cbegin() : deq.cend() - piece;
+                for (auto it = from; it != deq.cend(); ++it) pieces[i].push_back(*it);
+                deq.erase(from, deq.cend());
+            }
+            return pieces;
+        });
+    }
+    /// @brief lab::Deque behind one mutex, the baseline for the concurrent
+    /// queues.
+    template <class T>
+    class LockedDeque {
+    public:
+        void push_back(const T& value) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _deque.push_back(value);
+        }
+
+        void push_front(const T& value) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _deque.push_front(value);
+        }
+
+        bool try_pop_front(T& out) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_deque.empty()) return false;
+            out = std::move(_deque.front());
+            _deque.pop_front();
+            return true;
+        }
+
+        bool try_pop_back(T& out) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_deque.empty()) return false;
+            out = std::move(_deque.back());
+            _deque.pop_back();
+            return true;
+        }
+
+    private:
+        std::mutex _mutex;
+        Deque<T> _deque;
+    };
+
+    template <class Queue>
+    double spsc_throughput(std::size_t n) {
+        return measure([&] {
+            Queue queue;
+            std::thread producer([&] {
+                for (std::size_t i = 0; i < n; i++) queue.push_back(int(i));
+            });
+            int value;
+            for (std::size_t i = 0; i < n;)
+                if (queue.try_pop_front(value)) i++;
+                else std::this_thread::yield();
+            producer.join();
+        }, 3);
+    }
+
+    /// @return Mean round trip of one message bounced between two threads
+    /// over a pair of queues, in microseconds.
+    template <class Queue>
+    double spsc_round_trip(std::size_t trips) {
+        Queue ping, pong;
+        std::thread echo([&] {
+            int value;
+            for (std::size_t i = 0; i < trips; i++) {
+                while (!ping.try_pop_front(value)) std::this_thread::yield();
+                pong.push_back(value);
+            }
+        });
+        double ms = measure([&] {
+            int value;
+            for (std::size_t i = 0; i < trips / 5; i++) {
+                ping.push_back(int(i));
+                while (!pong.try_pop_front(value)) std::this_thread::yield();
+            }
+        });
+        echo.join();
+        return ms * 1000 / double(trips / 5);
+    }
+
+    void bench_spsc(std::size_t n, std::size_t trips) {
+        std::cout << "one producer, one consumer, " << n << " ints, "
+                  << std::thread::hardware_concurrency() << " hardware threads\n";
+        report("lab::SpscDeque", spsc_throughput<SpscDeque<int>>(n));
+        report("mutex + lab::Deque", spsc_throughput<LockedDeque<int>>(n));
+        std::cout << "ping-pong round trip, " << trips / 5 << " trips\n";
+        std::cout << "  lab::SpscDeque: " << spsc_round_trip<SpscDeque<int>>(trips)
+                  << " us\n";
+        std::cout << "  mutex + lab::Deque: " << spsc_round_trip<LockedDeque<int>>(trips)
+                  << " us\n";
+    }
+    /// @brief The head and tail of a bounded two-thread queue reduced to
+    /// their indices: Align = alignof keeps them side by side, as adjacent
+    /// members are, and CACHE_LINE_SIZE gives each a line of its own.
+    template <std::size_t Align>
+    struct IndexPair {
+        alignas(Align) std::atomic<std::size_t> head{0};
+        alignas(Align) std::atomic<std::size_t> tail{0};
+    };
+
+    /// @return Mean time for one element to go from the producer to the
+    /// consumer over a window of slots, in nanoseconds; a window of 1 is a
+    /// strict ping-pong. With Cached, each side keeps a copy of the other's
+    /// index and reloads it only when the copy says it has to wait.
+    template <std::size_t Align, bool Cached>
+    double index_ping_pong(std::size_t n, std::size_t window) {
+        double ms = measure([&] {
+            IndexPair<Align> pair;
+            std::thread consumer([&] {
+                std::size_t tail = 0;
+                for (std::size_t head = 0; head < n; head++) {
+                    if (!Cached) tail = pair.tail.load(std::memory_order_acquire);
+                    while (head == tail) {
+                        tail = pair.tail.load(std::memory_order_acquire);
+                        if (head == tail) std::this_thread::yield();
+                    }
+                    pair.head.store(head + 1, std::memory_order_release);
+                }
+            });
+            std::size_t head = 0;
+            for (std::size_t tail = 0; tail < n; tail++) {
+                if (!Cached) head = pair.head.load(std::memory_order_acquire);
+                while (tail - head >= window) {
+                    head = pair.head.load(std::memory_order_acquire);
+                    if (tail - head >= window) std::this_thread::yield();
+                }
+                pair.tail.store(tail + 1, std::memory_order_release);
+            }
+            consumer.join();
+        }, 3);
+        return ms * 1e6 / double(n);
+    }
+
+    void bench_false_sharing(std::size_t n, std::size_t trips) {
+        std::cout << "head and tail indices, " << n << " elements, "
+                  << std::thread::hardware_concurrency() << " hardware threads\n";
+        constexpr std::size_t packed = alignof(std::atomic<std::size_t>);
+        for (std::size_t window : {std::size_t(1), std::size_t(256)}) {
+            std::string suffix = ", window " + std::to_string(window) + ": ";
+            std::cout << "  same cache line" << suffix
+                      << index_ping_pong<packed, false>(n, window) << " ns\n";
+            std::cout << "  own cache lines" << suffix
+                      << index_ping_pong<CACHE_LINE_SIZE, false>(n, window) << " ns\n";
+            std::cout << "  own cache lines, cached copies" << suffix
+                      << index_ping_pong<CACHE_LINE_SIZE, true>(n, window) << " ns\n";
+        }
+        std::cout << "ping-pong round trip, " << trips / 5 << " trips\n";
+        std::cout << "  lab::SpscDeque: " << spsc_round_trip<SpscDeque<int>>(trips)
+                  << " us\n";
+        std::cout << "  lab::ConcurrentDeque: "
+                  << spsc_round_trip<ConcurrentDeque<int>>(trips) << " us\n";
+    }
+
+    /// @brief Every thread pushes and pops ops elements, half of the threads
+    /// at the back and half at the front.
+    template <class Queue>
+    double mpmc_time(unsigned threads, std::size_t ops) {
+        return measure([&] {
+            Queue queue;
+            for (int i = 0; i < 1024; i++) queue.push_back(i);
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; t++)
+                workers.emplace_back([&, t] {
+                    int value;
+                    for (std::size_t i = 0; i < ops / threads; i++) {
+                        if (t % 2) {
+                            queue.push_back(int(i));
+                            queue.try_pop_back(value);
+                        } else {
+                            queue.push_front(int(i));
+                            queue.try_pop_front(value);
+                        }
+                    }
+                });
+            for (auto& worker : workers) worker.join();
+        }, 3);
+    }
+
+    void bench_mpmc(std::size_t ops) {
+        std::cout << "push + pop at both ends, " << ops << " pairs in total, "
+                  << std::thread::hardware_concurrency() << " hardware threads\n";
+        for (unsigned threads = 1; threads <= 32; threads *= 2) {
+            report("lab::ConcurrentDeque, " + std::to_string(threads) + " threads",
+                   mpmc_time<ConcurrentDeque<int>>(threads, ops));
+            report("mutex + lab::Deque, " + std::to_string(threads) + " threads",
+                   mpmc_time<LockedDeque<int>>(threads, ops));
+        }
+    }
+    void bench_batches(std::size_t n, std::size_t batch) {
+        std::vector<int> values(batch), out(batch);
+        std::iota(values.begin(), values.end(), 0);
+        std::cout << "drain " << n << " ints in batches of " << batch << "\n";
+        Deque<int> deq;
+        report("lab::Deque, push_back + front/pop_front", measure([&] {
+                   for (std::size_t i = 0; i < n; i += batch)
+                       for (int v : values) deq.push_back(v);
+                   while (!deq.empty()) {
+                       for (std::size_t i = 0; i < batch; i++) {
+                           out[i] = deq.front();
+                           deq.pop_front();
+                       }
+                   }
+                   sink = out[0];
+               }));
+        report("lab::Deque, push_back_n + pop_front_n", measure([&] {
+                   for (std::size_t i = 0; i < n; i += batch) deq.push_back_n(values);
+                   while (!deq.empty()) deq.pop_front_n(batch, out.begin());
+                   sink = out[0];
+               }));
+
+        report("lab::SpscDeque, one by one", spsc_throughput<SpscDeque<int>>(n));
+        report("lab::SpscDeque, batched", measure([&] {
+                   SpscDeque<int> queue;
+                   std::thread producer([&] {
+                       for (std::size_t i = 0; i < n; i += batch) queue.push_back_n(values);
+                   });
+                   std::vector<int> got(batch);
+                   for (std::size_t i = 0; i < n;) {
+                       std::size_t k = queue.pop_front_n(batch, got.begin()) - got.begin();
+                       if (k == 0) std::this_thread::yield();
+                       i += k;
+                   }
+                   producer.join();
+               }, 3));
+
+        report("lab::ConcurrentDeque, one by one", spsc_throughput<ConcurrentDeque<int>>(n));
+        report("lab::ConcurrentDeque, batched", measure([&] {
+                   ConcurrentDeque<int> queue;
+                   std::thread producer([&] {
+                       for (std::size_t i = 0; i < n; i += batch) queue.push_back_n(values);
+                   });
+                   std::vector<int> got(batch);
+                   for (std::size_t i = 0; i < n;) {
+                       std::size_t k = queue.pop_front_n(batch, got.begin()) - got.begin();
+                       if (k == 0) std::this_thread::yield();
+                       i += k;
+                   }
+                   producer.join();
+               }, 3));
+    }
+    /// @brief One producer sends n timestamps through a channel of one chunk,
+    /// one consumer records how long each took to arrive.
+    void channel_latency(const std::string& name, WaitPolicy wait, std::size_t n) {
+        using clock = std::chrono::steady_clock;
+        Channel<std::int64_t> channel(1, wait);
+        std::vector<std::int64_t> latency;
+        latency.reserve(n);
+        auto start = clock::now();
+        std::thread consumer([&] {
+            std::int64_t stamp;
+            while (channel.pop(stamp))
+                latency.push_back(clock::now().time_since_epoch().count() - stamp);
+        });
+        for (std::size_t i = 0; i < n; i++)
+            channel.push(clock::now().time_since_epoch().count());
+        channel.close();
+        consumer.join();
+        std::chrono::duration<double, std::milli> total = clock::now() - start;
+
+        std::sort(latency.begin(), latency.end());
+        auto percentile = [&](double p) {
+            return double(latency[std::size_t(p * double(latency.size() - 1))]) / 1000;
+        };
+        std::cout << "  " << name << ": " << total.count() << " ms, latency p50 "
+                  << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, p99.9 "
+                  << percentile(0.999) << " us, max " << percentile(1) << " us\n";
+    }
+
+    void bench_channel(std::size_t n) {
+        std::cout << "lab::Channel, one producer, one consumer, " << n << " messages, "
+                  << std::thread::hardware_concurrency() << " hardware threads\n";
+        channel_latency("park at once", WaitPolicy{0, false}, n);
+        channel_latency("adaptive spin, then park", WaitPolicy{}, n);
+        channel_latency("spin up to 2000, then park", WaitPolicy{2000, false}, n);
+    }
+    /// @brief A writer keeps appending to a window of n events and trimming
+    /// it, while the reader sums the window reps times.
+    template <class Window, class Scan>
+    void snapshot_scan(const std::string& name, std::size_t n, int reps, Window& window,
+                       Scan scan) {
+        for (std::size_t i = 0; i < n; i++) window.append(std::int64_t(i));
+        std::atomic<bool> done{false};
+        std::atomic<std::size_t> appended{0};
+        std::thread writer([&] {
+            std::size_t i = n;
+            while (!done.load(std::memory_order_relaxed)) window.append(std::int64_t(i++));
+            appended = i - n;
+        });
+        auto start = std::chrono::steady_clock::now();
+        std::int64_t total = 0;
+        for (int r = 0; r < reps; r++) total += scan();
+        std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+        done = true;
+        writer.join();
+        sink = std::size_t(total);
+        std::cout << "  " << name << ": " << time.count() / reps << " ms per scan, writer "
+                  << double(appended) / time.count() / 1000 << "M appends/s\n";
+    }
+
+    void bench_snapshot(std::size_t n) {
+        std::cout << "scan a window of " << n << " events while a writer appends\n";
+        struct LockedWindow {
+            std::mutex mutex;
+            Deque<std::int64_t> events;
+            std::size_t limit;
+
+            void append(std::int64_t v) {
+                std::lock_guard<std::mutex> lock(mutex);
+                events.push_back(v);
+                if (events.size() > limit) events.pop_front();
+            }
+        } locked{{}, {}, n};
+        snapshot_scan("copy under a mutex", n, 20, locked, [&] {
+            Deque<std::int64_t> copy;
+            {
+                std::lock_guard<std::mutex> lock(locked.mutex);
+                copy = locked.events;
+            }
+            return sum(copy);
+        });
+
+        struct EpochWindow {
+            EpochDeque<std::int64_t> events;
+            std::size_t limit;
+
+            void append(std::int64_t v) {
+                events.push_back(v);
+                if (events.size() > limit) events.pop_front();
+            }
+        } epoch{EpochDeque<std::int64_t>(), n};
+        snapshot_scan("lab::EpochDeque snapshot", n, 20, epoch, [&] {
+            auto view         = epoch.events.snapshot();
+            std::int64_t part = 0;
+            view.for_each_segment([&](const std::int64_t* from, const std::int64_t* to) {
+                part = simd::reduce<true>(from, to, part, std::plus<>());
+            });
+            return part;
+        });
+    }
+    void bench_async(std::size_t trips) {
+        std::cout << "ping-pong handoff, " << trips << " round trips\n";
+        double ms = measure([&] {
+            Executor executor;
+            AsyncDeque<int> ping, pong;
+            auto echo = [&]() -> Job {
+                for (std::size_t i = 0; i < trips; i++)
+                    co_await pong.push_back(co_await ping.pop_front());
+            };
+            auto driver = [&]() -> Job {
+                for (std::size_t i = 0; i < trips; i++) {
+                    co_await ping.push_back(int(i));
+                    sink = std::size_t(co_await pong.pop_front());
+                }
+            };
+            executor.spawn(echo());
+            executor.spawn(driver());
+            executor.run();
+        });
+        std::cout << "  lab::AsyncDeque, two coroutines on one thread: "
+                  << ms * 1e6 / double(2 * trips) << " ns per handoff\n";
+
+        std::size_t thread_trips = trips / 100;
+        ms = measure([&] {
+            Channel<int> ping(1), pong(1);
+            std::thread echo([&] {
+                int value;
+                while (ping.pop(value)) pong.push(value);
+            });
+            int value;
+            for (std::size_t i = 0; i < thread_trips; i++) {
+                ping.push(int(i));
+                pong.pop(value);
+            }
+            ping.close();
+            echo.join();
+        }, 3);
+        std::cout << "  lab::Channel, two threads: " << ms * 1e6 / double(2 * thread_trips)
+                  << " ns per handoff\n";
+    }
+    /// @return Aggregate appends per microsecond of threads appending n
+    /// elements in total.
+    template <class Log>
+    double append_rate(unsigned threads, std::size_t n) {
+        double ms = measure([&] {
+            Log log;
+            std::vector<std::thread> writers;
+            for (unsigned t = 0; t < threads; t++)
+                writers.emplace_back([&] {
+                    for (std::size_t i = 0; i < n / threads; i++) log.push_back(int(i));
+                });
+            for (auto& writer : writers) writer.join();
+            std::vector<int> records;
+            records.reserve(n);
+            if constexpr (requires { log.drain_all(std::back_inserter(records)); })
+                log.drain_all(std::back_inserter(records));
+        }, 3);
+        return double(n) / ms / 1000;
+    }
+
+    void bench_sharded(std::size_t n) {
+        std::cout << "appends from several threads, " << n << " in total, "
+                  << std::thread::hardware_concurrency() << " hardware threads\n";
+        for (unsigned threads = 1; threads <= 8; threads *= 2) {
+            std::string suffix = ", " + std::to_string(threads) + " threads: ";
+            std::cout << "  mutex + lab::Deque" << suffix
+                      << append_rate<LockedDeque<int>>(threads, n) << "M/s\n";
+            std::cout << "  lab::ShardedDeque" << suffix
+                      << append_rate<ShardedDeque<int>>(threads, n) << "M/s\n";
+            std::cout << "  lab::ShardedDeque, ordered" << suffix
+                      << append_rate<ShardedDeque<int, true>>(threads, n) << "M/s\n";
+        }
+    }
+    void bench_steal(std::size_t n) {
+        std::cout << "work stealing, owner pushes " << n << " ints, thieves steal all\n";
+        for (unsigned thieves = 1; thieves <= 2 * std::thread::hardware_concurrency() + 2;
+             thieves *= 2) {
+            double ms = measure([&] {
+                WorkStealingDeque<int> deque;
+                std::atomic<std::size_t> stolen{0};
+                std::vector<std::thread> workers;
+                for (unsigned t = 0; t < thieves; t++)
+                    workers.emplace_back([&] {
+                        int value;
+                        while (stolen.load(std::memory_order_relaxed) < n)
+                            if (deque.try_steal(value))
+                                stolen.fetch_add(1, std::memory_order_relaxed);
+                            else
+                                std::this_thread::yield();
+                    });
+                for (std::size_t i = 0; i < n; i++) deque.push_back(int(i));
+                for (auto& worker : workers) worker.join();
+            }, 3);
+            report(std::to_string(thieves) + " thieves, " +
+                           std::to_string(std::size_t(n / ms / 1000)) + "M steals/s",
+                   ms);
+        }
+    }
+    long fib_sequential(int n) { return n < 2 ? n : fib_sequential(n - 1) + fib_sequential(n - 2); }
+
+    long fib_tasks(TaskPool& pool, int n, int cutoff) {
+        if (n < cutoff) return fib_sequential(n);
+        long a, b;
+        TaskPool::TaskGroup group(pool);
+        group.run([&] { a = fib_tasks(pool, n - 1, cutoff); });
+        b = fib_tasks(pool, n - 2, cutoff);
+        group.wait();
+        return a + b;
+    }
+
+    void bench_task_pool(std::size_t n) {
+        TaskPool pool;
+        volatile long result;
+        std::cout << "fib(40) task tree, " << pool.size() << " workers\n";
+        report("sequential", measure([&] { result = fib_sequential(40); }, 3));
+        for (int cutoff : {25, 20, 15})
+            report("lab::TaskPool, sequential below " + std::to_string(cutoff),
+                   measure([&] { result = fib_tasks(pool, 40, cutoff); }, 3));
+
+        Deque<int> deq(n, 1);
+        std::cout << "chunk scan, " << n << " ints\n";
+        report("sequential", measure([&] { result = sum(deq); }));
+        for (std::size_t parts : {std::size_t(pool.size()), 8 * std::size_t(pool.size())}) {
+            report("lab::TaskPool::parallel_for, " + std::to_string(parts) + " parts",
+                   measure([&] {
+                       std::vector<long> partial(parts);
+                       pool.parallel_for(std::size_t(0), parts, [&](std::size_t part) {
+                           auto first = chunk_partition_point(deq.begin(), deq.end(), part, parts);
+                           auto last  = chunk_partition_point(deq.begin(), deq.end(), part + 1,
+                                                              parts);
+                           for_each_segment(first, last, [&](int* from, int* to) {
+                               partial[part] += simd::reduce<true>(const_cast<const int*>(from), const_cast<const int*>(to), 0, std::plus<>());
+                           });
+                       });
+                       result = std::accumulate(partial.begin(), partial.end(), 0L);
+                   }));
+        }
+    }
+}  // namespace
+
+int main() {
+    bench_find<std::int8_t>("int8", 10'000'000);
+    bench_find<std::int16_t>("int16", 10'000'000);
+    bench_find<std::int32_t>("int32", 10'000'000);
+    bench_find<std::int64_t>("int64", 10'000'000);
+    bench_find<float>("float", 10'000'000);
+    bench_find<double>("double", 10'000'000);
+    bench_reduce(10'000'000);
+    bench_parallel_scaling(100'000'000);
+    bench_sort(10'000'000);
+    bench_bounds(10'000'000, 1'000'000);
+    bench_rotate(10'000'000);
+    bench_splice(5'120'000);
+    bench_split(10'000'000);
+    bench_spsc(10'000'000, 500'000);
+    bench_false_sharing(10'000'000, 500'000);
+    bench_mpmc(4'000'000);
+    bench_steal(4'000'000);
+    bench_task_pool(100'000'000);
+    bench_batches(10'240'000, 256);
+    bench_channel(1'000'000);
+    bench_snapshot(1'000'000);
+    bench_async(10'000'000);
+    bench_sharded(16'000'000);
+
+    return 0;
+}
@@ -1,9 +1,38 @@
 #pragma once
+#include <algorithm>
+#include <compare>
+#include <cstring>
+#include <functional>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "deque_simd.h"
 
 namespace lab {
+    /// @brief Distance that keeps two objects written by different threads
+    /// off each other's cache lines; the concurrent containers align their
+    /// per-thread state to it. GCC warns that the standard value depends on
+    /// the tuning flags, which is fine as long as every translation unit of a
+    /// program is built with the same ones.
+#ifdef __cpp_lib_hardware_interference_size
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+    inline constexpr std::size_t CACHE_LINE_SIZE = std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+    inline constexpr std::size_t CACHE_LINE_SIZE = 64;
+#endif
+
     template <typename T>
     class Allocator {
     public:
@@ -28,7 +57,7 @@ namespace lab {
             return static_cast<pointer>(::operator new(sizeof(T) * n));
         }
 
-        void deallocate(pointer p, size_type n) noexcept { delete[] p; }
+        void deallocate(pointer p, size_type n) noexcept { ::operator delete(p); }
 
         template <typename Other>
         struct rebind {
@@ -47,7 +76,7 @@ namespace lab {
         using difference_type   = std::ptrdiff_t;
         using pointer           = Pointer;
         using reference         = Reference;
-        using chunk_ptr         = std::__ptr_rebind<pointer, pointer>;
+        using chunk_ptr         = std::__ptr_rebind<pointer, value_type*>;
         using iter_type         = Deque_iterator<value_type, reference, pointer>;
 
         const static std::size_t CHUNK_SIZE =
@@ -61,25 +90,33 @@ namespace lab {
             _last      = *chunk + CHUNK_SIZE;
         }
 
-        Deque_iterator() noexcept;
+        Deque_iterator() noexcept
+                : _el(nullptr), _first(nullptr), _last(nullptr), _chunk_ptr(nullptr) {}
 
         Deque_iterator(chunk_ptr chunk, pointer ptr)
-                : _chunk_ptr(chunk),
+                : _el(ptr),
                   _first(*chunk),
                   _last(*chunk + CHUNK_SIZE),
-                  _el(ptr) {}
+                  _chunk_ptr(chunk) {}
 
         Deque_iterator(const Deque_iterator& other) noexcept = default;
 
-        Deque_iterator& operator=(const Deque_iterator& other) = default;
+        /// @brief Converts iterator to const_iterator.
+        template <typename OtherReference, typename OtherPointer,
+                  typename = std::enable_if_t<
+                          std::is_convertible_v<OtherPointer, pointer> &&
+                          !std::is_same_v<OtherPointer, pointer>>>
+        Deque_iterator(
+                const Deque_iterator<value_type, OtherReference, OtherPointer>&
+                        other) noexcept
+                : _el(other._el),
+                  _first(other._first),
+                  _last(other._last),
+                  _chunk_ptr(other._chunk_ptr) {}
 
-        ~Deque_iterator();
-
-        friend void swap(Deque_iterator<value_type, reference, pointer>&,
-                         Deque_iterator<value_type, reference, pointer>&);
+        Deque_iterator& operator=(const Deque_iterator& other) = default;
 
-        friend bool operator==(const iter_type&, const iter_type&);
-        friend bool operator!=(const iter_type&, const iter_type&);
+        ~Deque_iterator() = default;
 
         reference operator*() const { return *_el; }
 
@@ -117,16 +154,17 @@ namespace lab {
 
         Deque_iterator& operator+=(const difference_type& n) {
             difference_type offset = n + (_el - _first);
-            if (offset >= 0 && offset < CHUNK_SIZE) {
-                _el -= n;
+            if (offset >= 0 && offset < difference_type(CHUNK_SIZE)) {
+                _el += n;
             } else {
                 difference_type chunk_offset;
                 if (offset < 0)
-                    chunk_offset = difference_type((-offset - 1) / CHUNK_SIZE - 1);
+                    chunk_offset = -difference_type((-offset - 1) / CHUNK_SIZE) - 1;
                 else
                     chunk_offset = difference_type(offset / CHUNK_SIZE);
                 _set_chunk(_chunk_ptr + chunk_offset);
-                _el = _first + (offset - chunk_offset * CHUNK_SIZE);
+                _el = _first +
+                      (offset - chunk_offset * difference_type(CHUNK_SIZE));
             }
             return *this;
         }
@@ -144,17 +182,11 @@ namespace lab {
         }
 
         difference_type operator-(const iter_type& r) const {
-            return CHUNK_SIZE * (this->_chunk_ptr - r._chunk_ptr) +
+            return difference_type(CHUNK_SIZE) * (this->_chunk_ptr - r._chunk_ptr) +
                    (this->_el - this->_first) + (r._first - r._el);
         }
 
-        reference operator[](const difference_type& n) { return *(this + n); }
-
-        friend bool operator<(const iter_type&, const iter_type&);
-        friend bool operator<=(const iter_type&, const iter_type&);
-        friend bool operator>(const iter_type&, const iter_type&);
-        friend bool operator>=(const iter_type&, const iter_type&);
-        // operator<=> will be handy
+        reference operator[](const difference_type& n) const { return *(*this + n); }
     };
 
     template <typename ValueType, typename Reference, typename Pointer>
@@ -170,35 +202,52 @@ namespace lab {
     }
 
     template <typename ValueType, typename Reference, typename Pointer>
-    bool operator<(const Deque_iterator<ValueType, Reference, Pointer>& l,
-                   const Deque_iterator<ValueType, Reference, Pointer>& r) {
-        return (l._chunk_ptr < r._chunk_ptr) ||
-               (l._chunk_ptr == r._chunk_ptr && l._el < r._el);
+    std::strong_ordering operator<=>(
+            const Deque_iterator<ValueType, Reference, Pointer>& l,
+            const Deque_iterator<ValueType, Reference, Pointer>& r) {
+        if (l._chunk_ptr != r._chunk_ptr) return l._chunk_ptr <=> r._chunk_ptr;
+        return l._el <=> r._el;
     }
 
-    template <typename ValueType, typename Reference, typename Pointer>
-    bool operator<=(const Deque_iterator<ValueType, Reference, Pointer>& l,
-                    const Deque_iterator<ValueType, Reference, Pointer>& r) {
-        return (l._chunk_ptr < r._chunk_ptr) ||
-               (l._chunk_ptr == r._chunk_ptr && l._el <= r._el);
-    }
-
-    template <typename ValueType, typename Reference, typename Pointer>
-    bool operator>(const Deque_iterator<ValueType, Reference, Pointer>& l,
-                   const Deque_iterator<ValueType, Reference, Pointer>& r) {
-        return (l._chunk_ptr > r._chunk_ptr) ||
-               (l._chunk_ptr == r._chunk_ptr && l._el > r._el);
-    }
+    /// @brief Three-way comparison of two values the way the standard
+    /// containers do it: operator<=> if the type has one, operator< otherwise.
+    struct synth_three_way {
+        template <class T, class U>
+        constexpr auto operator()(const T& t, const U& u) const {
+            if constexpr (std::three_way_comparable_with<T, U>) {
+                return t <=> u;
+            } else {
+                if (t < u) return std::weak_ordering::less;
+                if (u < t) return std::weak_ordering::greater;
+                return std::weak_ordering::equivalent;
+            }
+        }
+    };
 
-    template <typename ValueType, typename Reference, typename Pointer>
-    bool operator>=(const Deque_iterator<ValueType, Reference, Pointer>& l,
-                    const Deque_iterator<ValueType, Reference, Pointer>& r) {
-        return (l._chunk_ptr > r._chunk_ptr) ||
-               (l._chunk_ptr == r._chunk_ptr && l._el >= r._el);
+    template <class T, class U = T>
+    using synth_three_way_result =
+            decltype(synth_three_way{}(std::declval<const T&>(), std::declval<const U&>()));
+
+    /// @brief Calls fn(first, last) for every contiguous part of the range
+    /// [first, last), i.e. once per chunk the range touches.
+    /// @param first,last range of a deque
+    /// @param fn callable taking a pair of raw pointers
+    template <typename ValueType, typename Reference, typename Pointer,
+              typename Fn>
+    void for_each_segment(Deque_iterator<ValueType, Reference, Pointer> first,
+                          Deque_iterator<ValueType, Reference, Pointer> last,
+                          Fn fn) {
+        using iter_type = Deque_iterator<ValueType, Reference, Pointer>;
+        if (first._chunk_ptr == last._chunk_ptr) {
+            fn(first._el, last._el);
+            return;
+        }
+        fn(first._el, first._last);
+        for (auto chunk = first._chunk_ptr + 1; chunk != last._chunk_ptr; chunk++)
+            fn(Pointer(*chunk), Pointer(*chunk + iter_type::CHUNK_SIZE));
+        fn(last._first, last._el);
     }
 
-// operator <=> will be handy
-
 // friend constexpr std::iter_rvalue_reference_t<Iter> iter_move( const
 // std::reverse_iterator& i ); // For extra points
 
@@ -224,10 +273,8 @@ namespace lab {
         using iterator = Deque_iterator<value_type, reference, pointer>;
         using const_iterator =
                 Deque_iterator<value_type, const_reference, const_pointer>;
-        using reverse_iterator =
-                std::reverse_iterator<Deque_iterator<iterator, reference, pointer>>;
-        using const_reverse_iterator = std::reverse_iterator<
-                Deque_iterator<iterator, const_reference, const_pointer>>;
+        using reverse_iterator       = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
     private:
         using alloc_traits      = std::allocator_traits<allocator_type>;
@@ -240,22 +287,491 @@ namespace lab {
         chunk_ptr _map;
         std::size_t _map_capacity, _el_size;
         iterator _begin, _end;
+        // chunks kept by clear() for reuse, linked through their first bytes
+        pointer _spare_chunks = nullptr;
+        size_type _spare_count = 0;
+
+        /// @brief Makes room in the map for chunks_to_add more chunk pointers
+        /// before _begin (add_at_front) or after _end. Recenters the used part of
+        /// the map if it is less than half full, otherwise grows it.
+        void reallocate(size_type chunks_to_add, bool add_at_front) {
+            size_type old_chunks = _end._chunk_ptr - _begin._chunk_ptr + 1;
+            size_type new_chunks = old_chunks + chunks_to_add;
+            chunk_ptr new_start;
+            if (_map_capacity > 2 * new_chunks) {
+                new_start = _map + (_map_capacity - new_chunks) / 2 +
+                            (add_at_front ? chunks_to_add : 0);
+                if (new_start < _begin._chunk_ptr)
+                    std::copy(_begin._chunk_ptr, _end._chunk_ptr + 1, new_start);
+                else
+                    std::copy_backward(_begin._chunk_ptr, _end._chunk_ptr + 1,
+                                       new_start + old_chunks);
+            } else {
+                size_type new_capacity =
+                        _map_capacity + std::max(_map_capacity, chunks_to_add) + 2;
+                if (new_capacity > max_size())
+                    throw std::length_error("Deque map is too large");
+                chunk_ptr new_map = _alloc_p.allocate(new_capacity);
+                new_start = new_map + (new_capacity - new_chunks) / 2 +
+                            (add_at_front ? chunks_to_add : 0);
+                std::copy(_begin._chunk_ptr, _end._chunk_ptr + 1, new_start);
+                _alloc_p.deallocate(_map, _map_capacity);
+                _map          = new_map;
+                _map_capacity = new_capacity;
+            }
+            _begin._set_chunk(new_start);
+            _end._set_chunk(new_start + old_chunks - 1);
+        }
+
+        void _reserve_map_back(size_type chunks_to_add = 1) {
+            if (chunks_to_add + 1 > _map_capacity - (_end._chunk_ptr - _map))
+                reallocate(chunks_to_add, false);
+        }
+
+        void _reserve_map_front(size_type chunks_to_add = 1) {
+            if (chunks_to_add > size_type(_begin._chunk_ptr - _map))
+                reallocate(chunks_to_add, true);
+        }
+
+        pointer _allocate_chunk() {
+            if (!_spare_chunks) return _alloc_t.allocate(CHUNK_SIZE);
+            pointer chunk = _spare_chunks;
+            _spare_chunks = *std::launder(reinterpret_cast<pointer*>(chunk));
+            _spare_count--;
+            return chunk;
+        }
+
+        void _push_spare_chunk(pointer chunk) noexcept {
+            ::new (static_cast<void*>(chunk)) pointer(_spare_chunks);
+            _spare_chunks = chunk;
+            _spare_count++;
+        }
+
+        /// @brief Allocates all the chunks needed to hold n more elements after
+        /// _end. Nothing is constructed.
+        /// @return Iterator that will become _end once the elements are built.
+        iterator _reserve_elements_back(size_type n) {
+            size_type vacancies = _end._last - _end._el - 1;
+            if (n > vacancies) {
+                size_type new_chunks = (n - vacancies + CHUNK_SIZE - 1) / CHUNK_SIZE;
+                _reserve_map_back(new_chunks);
+                size_type i = 1;
+                try {
+                    for (; i <= new_chunks; i++)
+                        *(_end._chunk_ptr + i) = _allocate_chunk();
+                } catch (...) {
+                    _deallocate_chunks(_end._chunk_ptr + 1, _end._chunk_ptr + i);
+                    throw;
+                }
+            }
+            return _end + difference_type(n);
+        }
+
+        /// @brief Allocates all the chunks needed to hold n more elements before
+        /// _begin. Nothing is constructed.
+        /// @return Iterator that will become _begin once the elements are built.
+        iterator _reserve_elements_front(size_type n) {
+            size_type vacancies = _begin._el - _begin._first;
+            if (n > vacancies) {
+                size_type new_chunks = (n - vacancies + CHUNK_SIZE - 1) / CHUNK_SIZE;
+                _reserve_map_front(new_chunks);
+                size_type i = 1;
+                try {
+                    for (; i <= new_chunks; i++)
+                        *(_begin._chunk_ptr - i) = _allocate_chunk();
+                } catch (...) {
+                    _deallocate_chunks(_begin._chunk_ptr - i + 1, _begin._chunk_ptr);
+                    throw;
+                }
+            }
+            return _begin - difference_type(n);
+        }
+
+        /// @brief Appends n elements built in place by construct(from, to), which
+        /// is called once per contiguous span of raw memory. On exception the
+        /// already built spans are destroyed and the new chunks are freed.
+        template <class Construct>
+        void _append_segments(size_type n, Construct construct) {
+            iterator new_end = _reserve_elements_back(n);
+            iterator built   = _end;
+            try {
+                for_each_segment(_end, new_end, [&](pointer from, pointer to) {
+                    construct(from, to);
+                    built += to - from;
+                });
+            } catch (...) {
+                _destroy(_end, built);
+                _deallocate_chunks(_end._chunk_ptr + 1, new_end._chunk_ptr + 1);
+                throw;
+            }
+            _end = new_end;
+            _el_size += n;
+        }
+
+        /// @brief Same as _append_segments, but for n elements before _begin.
+        /// The spans are visited front to back.
+        template <class Construct>
+        void _prepend_segments(size_type n, Construct construct) {
+            iterator new_begin = _reserve_elements_front(n);
+            iterator built     = new_begin;
+            try {
+                for_each_segment(new_begin, _begin, [&](pointer from, pointer to) {
+                    construct(from, to);
+                    built += to - from;
+                });
+            } catch (...) {
+                _destroy(new_begin, built);
+                _deallocate_chunks(new_begin._chunk_ptr, _begin._chunk_ptr);
+                throw;
+            }
+            _begin = new_begin;
+            _el_size += n;
+        }
+
+        void _deallocate_chunk(pointer chunk) noexcept {
+            _alloc_t.deallocate(chunk, CHUNK_SIZE);
+        }
 
-        void reallocate(std::size_t new_size) {
-            if (_map_capacity == 0) _map_capacity = 8;
-            while (_map_capacity < new_size) _map_capacity << 2;
-            if (_map_capacity > max_size())
-                ;
-            // throw some error
-            chunk_ptr _copy_map = _alloc_p.allocate(_map_capacity);
-            std::size_t ind     = (_map_capacity - new_size) >> 1;
-            for (auto chunkID = _begin._chunk_ptr; chunkID <= _end.chunkID;
-                 chunkID++)
-                _copy_map[ind++] = chunkID;
-            _begin._chunk_ptr = &_map[ind];
-            _end._chunk_ptr   = &_map[ind + (_end.chunkID - _begin._chunk_ptr)];
-            _alloc_p.deallocate(_map);
-            _map = _copy_map;
+        /// @brief Returns the chunks in the map cells [first, last) to the
+        /// allocator.
+        void _deallocate_chunks(chunk_ptr first, chunk_ptr last) noexcept {
+            for (; first < last; first++) _deallocate_chunk(*first);
+        }
+
+        void _destroy_span(pointer from, pointer to) noexcept {
+            if constexpr (!std::is_trivially_destructible_v<T>)
+                for (; from != to; from++) alloc_traits::destroy(_alloc_t, from);
+        }
+
+        /// @brief Destroys the elements of [first, last) chunk by chunk. Does
+        /// nothing for trivially destructible T.
+        void _destroy(iterator first, iterator last) noexcept {
+            if constexpr (!std::is_trivially_destructible_v<T>)
+                for_each_segment(first, last, [this](pointer from, pointer to) {
+                    _destroy_span(from, to);
+                });
+        }
+
+        /// @brief Move-assigns [first, last) to the range starting at dest, front
+        /// to back, one contiguous piece at a time. dest may overlap the source
+        /// from the left.
+        static iterator _move_segments(iterator first, iterator last,
+                                       iterator dest) {
+            difference_type count = last - first;
+            while (count > 0) {
+                difference_type len = std::min({count, first._last - first._el,
+                                                 dest._last - dest._el});
+                std::move(first._el, first._el + len, dest._el);
+                first += len;
+                dest += len;
+                count -= len;
+            }
+            return dest;
+        }
+
+        /// @brief Move-assigns [first, last) to the range ending at dest_last,
+        /// back to front, one contiguous piece at a time. The destination may
+        /// overlap the source from the right.
+        static iterator _move_backward_segments(iterator first, iterator last,
+                                                iterator dest_last) {
+            difference_type count = last - first;
+            while (count > 0) {
+                difference_type src_len =
+                        last._el == last._first ? CHUNK_SIZE : last._el - last._first;
+                difference_type dest_len = dest_last._el == dest_last._first
+                                           ? CHUNK_SIZE
+                                           : dest_last._el - dest_last._first;
+                difference_type len = std::min({count, src_len, dest_len});
+                pointer src_end  = last._el == last._first
+                                   ? *(last._chunk_ptr - 1) + CHUNK_SIZE
+                                   : last._el;
+                pointer dest_end = dest_last._el == dest_last._first
+                                   ? *(dest_last._chunk_ptr - 1) + CHUNK_SIZE
+                                   : dest_last._el;
+                std::move_backward(src_end - len, src_end, dest_end);
+                last -= len;
+                dest_last -= len;
+                count -= len;
+            }
+            return dest_last;
+        }
+
+        /// @brief Returns the length of the common prefix of two arrays of n
+        /// elements. Integral types are compared with memcmp, floating point
+        /// types in branch-free blocks the compiler can vectorize.
+        static size_type _common_prefix_span(const T* a, const T* b, size_type n) {
+            size_type i = 0;
+            if constexpr (std::is_integral_v<T> || std::is_enum_v<T> ||
+                          std::is_pointer_v<T>) {
+                if (std::memcmp(a, b, n * sizeof(T)) == 0) return n;
+                constexpr size_type block = 64 / sizeof(T);
+                while (i + block <= n && std::memcmp(a + i, b + i, sizeof(T) * block) == 0)
+                    i += block;
+            } else if constexpr (std::is_floating_point_v<T>) {
+                constexpr size_type block = 16;
+                for (; i + block <= n; i += block) {
+                    bool differ = false;
+                    for (size_type k = 0; k < block; k++) differ |= !(a[i + k] == b[i + k]);
+                    if (differ) break;
+                }
+            }
+            while (i < n && a[i] == b[i]) i++;
+            return i;
+        }
+
+        /// @brief Returns how many leading elements of lhs and rhs are equal.
+        /// Both deques are walked as pairs of contiguous spans, whatever the
+        /// offsets of their chunk boundaries are.
+        static size_type _common_prefix(const Deque& lhs, const Deque& rhs) {
+            size_type n = std::min(lhs.size(), rhs.size()), done = 0;
+            const_iterator l = lhs.begin(), r = rhs.begin();
+            while (done < n) {
+                size_type len = std::min<size_type>(
+                        {n - done, size_type(l._last - l._el), size_type(r._last - r._el)});
+                size_type same = _common_prefix_span(l._el, r._el, len);
+                done += same;
+                if (same != len) break;
+                l += len;
+                r += len;
+            }
+            return done;
+        }
+
+        /// @brief Calls search(from, to) on each contiguous span of the deque in
+        /// order until it returns something other than to.
+        /// @return Iterator to the pointer returned by search, or end().
+        template <class Search>
+        iterator _find_segments(Search search) {
+            chunk_ptr chunk = _begin._chunk_ptr;
+            pointer from    = _begin._el;
+            while (true) {
+                pointer to    = chunk == _end._chunk_ptr ? _end._el : *chunk + CHUNK_SIZE;
+                pointer found = search(from, to);
+                if (found != to) return iterator(chunk, found);
+                if (chunk == _end._chunk_ptr) return _end;
+                chunk++;
+                from = *chunk;
+            }
+        }
+
+        /// @brief Two-level binary search for a deque partitioned by before:
+        /// first over the head elements of the chunks through the map, then
+        /// inside the one chunk that holds the partition point.
+        /// @return Iterator to the first element for which before is false,
+        /// or end().
+        template <class Before>
+        iterator _partition_point_segments(Before before) {
+            chunk_ptr first_chunk = _begin._chunk_ptr;
+            // the chunk of end() holds no elements when end() is its first slot
+            chunk_ptr last_chunk = _end._chunk_ptr + (_end._el != _end._first);
+            if (first_chunk == last_chunk) return _end;
+            chunk_ptr next = std::partition_point(
+                    first_chunk + 1, last_chunk,
+                    [&before](const pointer& chunk) { return before(*chunk); });
+            chunk_ptr chunk = next - 1;
+            pointer from    = chunk == first_chunk ? _begin._el : *chunk;
+            pointer to      = chunk == _end._chunk_ptr ? _end._el : *chunk + CHUNK_SIZE;
+            pointer found   = std::partition_point(from, to, before);
+            if (found != to) return iterator(chunk, found);
+            return next == last_chunk ? _end : iterator(next, *next);
+        }
+
+        bool _same_allocator(const Deque& other) const {
+            if constexpr (alloc_traits::is_always_equal::value)
+                return true;
+            else
+                return _alloc_t == other._alloc_t;
+        }
+
+        /// @brief Move-constructs elements from src onwards into the raw span
+        /// [from, to), one contiguous piece of the source at a time, and
+        /// advances src past them. On exception the built part is destroyed.
+        void _uninitialized_move_span(iterator& src, pointer from, pointer to) {
+            pointer cur = from;
+            try {
+                while (cur != to) {
+                    difference_type len = std::min(to - cur, src._last - src._el);
+                    std::uninitialized_move(src._el, src._el + len, cur);
+                    cur += len;
+                    src += len;
+                }
+            } catch (...) {
+                _destroy_span(from, cur);
+                throw;
+            }
+        }
+
+        /// @brief Takes the emptied chunks in the map cells [first, last) of
+        /// other: they go to our spare list when the allocators compare equal,
+        /// so the next span we build reuses them, and back to other's
+        /// allocator otherwise.
+        void _take_chunks(Deque& other, chunk_ptr first, chunk_ptr last, bool recycle) noexcept {
+            for (; first < last; first++)
+                if (recycle) _push_spare_chunk(*first);
+                else other._deallocate_chunk(*first);
+        }
+
+        /// @brief Appends the elements of other by moving them, one chunk of
+        /// other at a time, and leaves other empty with its last chunk. Every
+        /// chunk of other is handed over by _take_chunks as soon as it is
+        /// empty, so with equal allocators the splice allocates at most one
+        /// chunk and frees none. If a move throws, the chunks moved so far stay
+        /// here and the rest stay in other.
+        void _move_append(Deque& other) {
+            bool recycle = _same_allocator(other);
+            while (other._el_size > 0) {
+                size_type n = std::min<size_type>(other._el_size,
+                                                  other._begin._last - other._begin._el);
+                pointer src = other._begin._el;
+                _append_segments(n, [&src](pointer from, pointer to) {
+                    std::uninitialized_move(src, src + (to - from), from);
+                    src += to - from;
+                });
+                iterator new_begin = other._begin + difference_type(n);
+                other._destroy_span(other._begin._el, src);
+                _take_chunks(other, other._begin._chunk_ptr, new_begin._chunk_ptr, recycle);
+                other._begin = new_begin;
+                other._el_size -= n;
+            }
+        }
+
+        /// @brief Same as _move_append, but the elements are put before _begin,
+        /// starting with the last chunk of other, and other is left with its
+        /// first chunk.
+        void _move_prepend(Deque& other) {
+            bool recycle = _same_allocator(other);
+            while (other._el_size > 0) {
+                size_type in_chunk = other._end._el == other._end._first
+                                     ? CHUNK_SIZE
+                                     : other._end._el - other._end._first;
+                size_type n        = std::min(other._el_size, in_chunk);
+                iterator new_end   = other._end - difference_type(n);
+                pointer src        = new_end._el;
+                _prepend_segments(n, [&src](pointer from, pointer to) {
+                    std::uninitialized_move(src, src + (to - from), from);
+                    src += to - from;
+                });
+                other._destroy_span(new_end._el, src);
+                _take_chunks(other, new_end._chunk_ptr + 1, other._end._chunk_ptr + 1, recycle);
+                other._end = new_end;
+                other._el_size -= n;
+            }
+        }
+
+        /// @brief Appends the elements of other by taking over its chunks. The
+        /// first element of other must sit at the same offset in its chunk as
+        /// _end does in the last chunk of this deque: the elements of the
+        /// first chunk of other are moved into the free tail of that chunk,
+        /// the rest of the chunks of other are linked into the map as they
+        /// are. other is left empty with its first chunk.
+        void _steal_chunks_back(Deque& other) {
+            chunk_ptr other_first = other._begin._chunk_ptr;
+            size_type chunks      = other._end._chunk_ptr - other_first;
+            if (chunks > 0) _reserve_map_back(chunks);
+            pointer from = other._begin._el;
+            pointer to   = chunks == 0 ? other._end._el : other._begin._last;
+            std::uninitialized_move(from, to, _end._el);
+            other._destroy_span(from, to);
+            if (chunks == 0) {
+                _end._el += to - from;
+            } else {
+                std::copy(other_first + 1, other_first + chunks + 1, _end._chunk_ptr + 1);
+                _end = iterator(_end._chunk_ptr + chunks,
+                                *(_end._chunk_ptr + chunks) +
+                                        (other._end._el - other._end._first));
+                other._end = iterator(other_first, *other_first);
+            }
+            other._begin = other._end;
+            _el_size += other._el_size;
+            other._el_size = 0;
+        }
+
+        /// @brief Moves the first count elements to the back. They are
+        /// move-constructed span by span into the chunks _append_segments
+        /// reserves, then destroyed and their emptied chunks freed at once.
+        /// The source is found from _begin inside every span, since reserving
+        /// the chunks may reallocate the map.
+        void _rotate_elements_left(size_type count) {
+            size_type moved = 0;
+            _append_segments(count, [this, &moved](pointer from, pointer to) {
+                iterator src = _begin + difference_type(moved);
+                _uninitialized_move_span(src, from, to);
+                moved += to - from;
+            });
+            iterator new_begin = _begin + difference_type(count);
+            _destroy(_begin, new_begin);
+            _deallocate_chunks(_begin._chunk_ptr, new_begin._chunk_ptr);
+            _begin = new_begin;
+            _el_size -= count;
+        }
+
+        /// @brief Same as _rotate_elements_left, but moves the last count
+        /// elements to the front.
+        void _rotate_elements_right(size_type count) {
+            size_type moved = 0;
+            _prepend_segments(count, [this, count, &moved](pointer from, pointer to) {
+                iterator src = _end - difference_type(count - moved);
+                _uninitialized_move_span(src, from, to);
+                moved += to - from;
+            });
+            iterator new_end = _end - difference_type(count);
+            _destroy(new_end, _end);
+            _deallocate_chunks(new_end._chunk_ptr + 1, _end._chunk_ptr + 1);
+            _end = new_end;
+            _el_size -= count;
+        }
+
+        /// @brief Inserts the elements produce() passes to its argument, in
+        /// order, before pos. They are built at the nearer end of the deque
+        /// and rotated into place, so only the shorter side moves. If an
+        /// element throws, the ones built so far are removed again.
+        template <class Produce>
+        iterator _insert_at(const_iterator pos, Produce produce) {
+            size_type index = pos - cbegin();
+            bool at_front   = index < _el_size / 2;
+            size_type added = 0;
+            try {
+                produce([&](auto&&... args) {
+                    if (at_front) emplace_front(std::forward<decltype(args)>(args)...);
+                    else emplace_back(std::forward<decltype(args)>(args)...);
+                    added++;
+                });
+            } catch (...) {
+                for (; added > 0; added--) at_front ? pop_front() : pop_back();
+                throw;
+            }
+            iterator first = begin();
+            if (at_front) {
+                std::reverse(first, first + added);
+                std::rotate(first, first + added, first + (added + index));
+            } else {
+                std::rotate(first + index, first + (_el_size - added), end());
+            }
+            return begin() + index;
+        }
+
+        /// @brief Forgets the storage after it was moved to another deque.
+        /// The deque is left empty and without a map; only destruction,
+        /// clear() and assignment to it are valid.
+        void _leave_empty() noexcept {
+            _map          = nullptr;
+            _map_capacity = 0;
+            _el_size      = 0;
+            _begin = _end = iterator();
+            _spare_chunks = nullptr;
+            _spare_count  = 0;
+        }
+
+        /// @brief Destroys the elements and gives all the memory back to the
+        /// allocators.
+        void _release_storage() noexcept {
+            if (!_map) return;
+            _destroy(_begin, _end);
+            _deallocate_chunks(_begin._chunk_ptr, _end._chunk_ptr + 1);
+            while (_spare_chunks) _deallocate_chunk(_allocate_chunk());
+            _alloc_p.deallocate(_map, _map_capacity);
+            _map      = nullptr;
+            _el_size  = 0;
         }
 
     public:
@@ -289,10 +805,7 @@ namespace lab {
         /// container
         Deque(size_type count, const T& value, const Allocator& alloc = Allocator())
                 : Deque(alloc) {
-            reallocate(count);
-            for (auto iter = _begin; iter != _begin + count; iter++) *iter = value;
-            _end     = _begin + count;
-            _el_size = count;
+            resize(count, value);
         }
 
         /// @brief Constructs the container with count default-inserted instances of
@@ -301,7 +814,9 @@ namespace lab {
         /// @param alloc allocator to use for all memory allocations of this
         /// container
         explicit Deque(size_type count, const Allocator& alloc = Allocator())
-                : Deque(count, 0, alloc){};
+                : Deque(alloc) {
+            resize(count);
+        }
 
         /// @brief Constructs the container with the contents of the range [first,
         /// last).
@@ -309,17 +824,10 @@ namespace lab {
         /// @param first, last 	the range to copy the elements from
         /// @param alloc allocator to use for all memory allocations of this
         /// container
-        template <class InputIt>
+        template <class InputIt, class = std::enable_if_t<!std::is_integral_v<InputIt>>>
         Deque(InputIt first, InputIt last, const Allocator& alloc = Allocator())
                 : Deque(alloc) {
-            reallocate(last - first);
-            auto cur = first;
-            _end     = _begin + (last - first);
-            for (auto iter = _begin; iter != _end; iter++) {
-                *iter = *cur;
-                cur++;
-            }
-            _el_size = last - first;
+            for (; first != last; first++) push_back(*first);
         }
 
         /// @brief Copy constructor. Constructs the container with the copy of the
@@ -349,13 +857,15 @@ namespace lab {
          */
         Deque(Deque&& other) {
             _map          = other._map;
-            other._map    = nullptr;
             _alloc_p      = other._alloc_p;
             _alloc_t      = other._alloc_t;
             _map_capacity = other._map_capacity;
             _el_size      = other._el_size;
             _begin        = other._begin;
             _end          = other._end;
+            _spare_chunks = other._spare_chunks;
+            _spare_count  = other._spare_count;
+            other._leave_empty();
         }
 
         /**
@@ -384,7 +894,7 @@ namespace lab {
                 : Deque(init.begin(), init.end(), alloc) {}
 
         /// @brief Destructs the deque.
-        ~Deque() { clear(); }
+        ~Deque() { _release_storage(); }
 
         /// @brief Copy assignment operator. Replaces the contents with a copy of
         /// the contents of other.
@@ -406,15 +916,18 @@ namespace lab {
          * @return *this
          */
         Deque& operator=(Deque&& other) {
-            clear();
+            if (this == &other) return *this;
+            _release_storage();
             _map          = other._map;
-            other._map    = nullptr;
             _alloc_p      = other._alloc_p;
             _alloc_t      = other._alloc_t;
             _map_capacity = other._map_capacity;
             _el_size      = other._el_size;
             _begin        = other._begin;
             _end          = other._end;
+            _spare_chunks = other._spare_chunks;
+            _spare_count  = other._spare_count;
+            other._leave_empty();
 
             return *this;
         }
@@ -566,7 +1079,7 @@ namespace lab {
         /// the deque is empty, the returned iterator is equal to rend().
         /// @return Reverse iterator to the first element.
         reverse_iterator rbegin() noexcept {
-            return static_cast<reverse_iterator>(_begin);
+            return reverse_iterator(_end);
         }
 
         /// @brief Returns a const reverse iterator to the first element of the
@@ -574,12 +1087,12 @@ namespace lab {
         /// deque. If the deque is empty, the returned iterator is equal to rend().
         /// @return Const Reverse iterator to the first element.
         const_reverse_iterator rbegin() const noexcept {
-            return static_cast<const_reverse_iterator>(_begin - 1);
+            return const_reverse_iterator(cend());
         }
 
         /// @brief Same to rbegin()
         const_reverse_iterator crbegin() const noexcept {
-            return static_cast<const_reverse_iterator>(_begin - 1);
+            return const_reverse_iterator(cend());
         }
 
         /// @brief Returns a reverse iterator to the element following the last
@@ -588,7 +1101,7 @@ namespace lab {
         /// placeholder, attempting to access it results in undefined behavior.
         /// @return Reverse iterator to the element following the last element.
         reverse_iterator rend() noexcept {
-            return static_cast<reverse_iterator>(_end - 1);
+            return reverse_iterator(_begin);
         }
 
         /// @brief Returns a const reverse iterator to the element following the
@@ -598,12 +1111,12 @@ namespace lab {
         /// @return Const Reverse iterator to the element following the last
         /// element.
         const_reverse_iterator rend() const noexcept {
-            return static_cast<const_reverse_iterator>(_end - 1);
+            return const_reverse_iterator(cbegin());
         }
 
         /// @brief Same to rend()
         const_reverse_iterator crend() const noexcept {
-            return static_cast<const_reverse_iterator>(_end - 1);
+            return const_reverse_iterator(cbegin());
         }
 
         /// CAPACITY
@@ -620,8 +1133,8 @@ namespace lab {
         /// hold due to system or library implementation limitations
         /// @return Maximum number of elements.
         size_type max_size() const noexcept {
-            return std::min(alloc_traits::max_size(),
-                            std::numeric_limits<difference_type>::max());
+            return std::min<size_type>(alloc_traits::max_size(_alloc_t),
+                                       std::numeric_limits<difference_type>::max());
         }
 
         /// @brief Requests the removal of unused capacity.
@@ -662,44 +1175,143 @@ namespace lab {
             _map_capacity = _size;  // проверить как capacity в других функциях
         }
 
+        /// LOOKUP
+
+        /// @brief Finds the first element equal to value. The deque is searched
+        /// chunk by chunk; integral elements are compared with SSE2/AVX2
+        /// kernels chosen at runtime.
+        /// @param value value to search for
+        /// @return Iterator to the found element, or end().
+        iterator find(const T& value) {
+            return _find_segments([&value](pointer from, pointer to) {
+                return from + (simd::find<T>(from, to, value) - from);
+            });
+        }
+
+        /// @brief Same as find(), for a const deque.
+        const_iterator find(const T& value) const {
+            return const_cast<Deque*>(this)->find(value);
+        }
+
+        /// @brief Finds the first element for which pred returns true.
+        /// @param pred unary predicate
+        /// @return Iterator to the found element, or end().
+        template <class Pred>
+        iterator find_if(Pred pred) {
+            return _find_segments([&pred](pointer from, pointer to) {
+                while (from != to && !pred(*from)) from++;
+                return from;
+            });
+        }
+
+        /// @brief Same as find_if(), for a const deque.
+        template <class Pred>
+        const_iterator find_if(Pred pred) const {
+            return const_cast<Deque*>(this)->find_if(
+                    [&pred](const T& el) { return pred(el); });
+        }
+
+        /// @brief Counts the elements equal to value, chunk by chunk.
+        /// @param value value to count
+        /// @return Number of elements equal to value.
+        size_type count(const T& value) const {
+            size_type n = 0;
+            for_each_segment(begin(), end(), [&](const_pointer from, const_pointer to) {
+                n += simd::count<T>(from, to, value);
+            });
+            return n;
+        }
+
+        /// @brief Checks if there is an element equal to value.
+        /// @param value value to search for
+        /// @return true if there is such element, false otherwise
+        bool contains(const T& value) const { return find(value) != end(); }
+
+        /// @brief Finds the first element that is not ordered before value in
+        /// a deque sorted by comp. The search probes one head element per
+        /// chunk through the map and then one contiguous chunk, so no probe
+        /// goes through iterator arithmetic.
+        /// @param value value to compare the elements to
+        /// @param comp comparison function object
+        /// @return Iterator to the found element, or end().
+        template <class Compare = std::less<>>
+        iterator lower_bound(const T& value, Compare comp = Compare()) {
+            return _partition_point_segments(
+                    [&](const T& el) { return bool(comp(el, value)); });
+        }
+
+        /// @brief Same as lower_bound(), for a const deque.
+        template <class Compare = std::less<>>
+        const_iterator lower_bound(const T& value, Compare comp = Compare()) const {
+            return const_cast<Deque*>(this)->lower_bound(value, comp);
+        }
+
+        /// @brief Finds the first element ordered after value in a deque
+        /// sorted by comp, the same way as lower_bound().
+        /// @param value value to compare the elements to
+        /// @param comp comparison function object
+        /// @return Iterator to the found element, or end().
+        template <class Compare = std::less<>>
+        iterator upper_bound(const T& value, Compare comp = Compare()) {
+            return _partition_point_segments(
+                    [&](const T& el) { return !bool(comp(value, el)); });
+        }
+
+        /// @brief Same as upper_bound(), for a const deque.
+        template <class Compare = std::less<>>
+        const_iterator upper_bound(const T& value, Compare comp = Compare()) const {
+            return const_cast<Deque*>(this)->upper_bound(value, comp);
+        }
+
         /// MODIFIERS
 
         /// @brief Erases all elements from the container.
-        /// nvalidates any references, pointers, or iterators referring to contained
-        /// elements. Any past-the-end iterators are also invalidated.
-        void clear() noexcept {
-            for (auto iter = _begin; iter != _end; iter++)
-                alloc_traits::destroy(_alloc_t, &(*iter));
-
-            if (_begin._chunk_ptr == _end._chunk_ptr)
-                _alloc_p.deallocate(_begin._chunk_ptr, size());
-
-            else {
-                _alloc_p.deallocate(_begin._chunk_ptr, abs(_begin._el - _begin._last));
-                _alloc_p.deallocate(_end._chunk_ptr, abs(_begin._el - _begin._first));
-                for (auto chunkID = _begin._chunk_ptr + 1; chunkID < _end._chunk_ptr;
-                     chunkID++) {
-                    _alloc_p.deallocate(chunkID, CHUNK_SIZE);
-                }
-                _alloc_p.deallocate(_map, 0);
-                _el_size      = 0;
-                _map_capacity = 0;
+        /// Invalidates any references, pointers, or iterators referring to
+        /// contained elements. Any past-the-end iterators are also invalidated.
+        /// The map is kept, and so are up to chunks_to_keep chunks (at least
+        /// one, recentered in the map), so refilling the deque does not go back
+        /// to the allocator. Elements of trivially destructible T are not
+        /// visited at all. A moved-from deque owns no storage and is left as
+        /// it is.
+        /// @param chunks_to_keep how many chunks to retain for reuse
+        void clear(size_type chunks_to_keep = 1) noexcept {
+            if (!_map) return;
+            _destroy(_begin, _end);
+
+            pointer kept = *_begin._chunk_ptr;
+            for (chunk_ptr chunk = _begin._chunk_ptr + 1; chunk <= _end._chunk_ptr;
+                 chunk++) {
+                if (_spare_count + 1 < chunks_to_keep)
+                    _push_spare_chunk(*chunk);
+                else
+                    _deallocate_chunk(*chunk);
             }
+
+            chunk_ptr center = _map + _map_capacity / 2;
+            *center          = kept;
+            _begin._set_chunk(center);
+            _begin._el = _begin._first + CHUNK_SIZE / 2;
+            _end       = _begin;
+            _el_size   = 0;
         }
 
+        /// @brief Erases all elements and gives all the memory back to the
+        /// allocator. The container is left as if default-constructed.
+        void clear_and_release() { *this = Deque(_alloc_t); }
+
         /// @brief Inserts value before pos.
         /// @param pos iterator before which the content will be inserted.
         /// @param value element value to insert
         /// @return Iterator pointing to the inserted value.
-        iterator insert(const_iterator pos, const T& value) {
-            // реализовать отдельную функцию сдвига элементов
-        }
+        iterator insert(const_iterator pos, const T& value) { return emplace(pos, value); }
 
         /// @brief Inserts value before pos.
         /// @param pos iterator before which the content will be inserted.
         /// @param value element value to insert
         /// @return Iterator pointing to the inserted value.
-        iterator insert(const_iterator pos, T&& value);
+        iterator insert(const_iterator pos, T&& value) {
+            return emplace(pos, std::move(value));
+        }
 
         /// @brief Inserts count copies of the value before pos.
         /// @param pos iterator before which the content will be inserted.
@@ -707,7 +1319,11 @@ namespace lab {
         /// @param value element value to insert
         /// @return Iterator pointing to the first element inserted, or pos if count
         /// == 0.
-        iterator insert(const_iterator pos, size_type count, const T& value);
+        iterator insert(const_iterator pos, size_type count, const T& value) {
+            return _insert_at(pos, [&](auto put) {
+                for (size_type i = 0; i < count; i++) put(value);
+            });
+        }
 
         /// @brief Inserts elements from range [first, last) before pos.
         /// @tparam InputIt Input Iterator
@@ -716,137 +1332,294 @@ namespace lab {
         /// into container for which insert is called
         /// @return Iterator pointing to the first element inserted, or pos if first
         /// == last.
-        template <class InputIt>
-        iterator insert(const_iterator pos, InputIt first, InputIt last);
+        template <class InputIt, class = std::enable_if_t<!std::is_integral_v<InputIt>>>
+        iterator insert(const_iterator pos, InputIt first, InputIt last) {
+            return _insert_at(pos, [&](auto put) {
+                for (; first != last; ++first) put(*first);
+            });
+        }
 
         /// @brief Inserts elements from initializer list before pos.
         /// @param pos iterator before which the content will be inserted.
         /// @param ilist initializer list to insert the values from
         /// @return Iterator pointing to the first element inserted, or pos if ilist
         /// is empty.
-        iterator insert(const_iterator pos, std::initializer_list<T> ilist);
+        iterator insert(const_iterator pos, std::initializer_list<T> ilist) {
+            return insert(pos, ilist.begin(), ilist.end());
+        }
 
         /// @brief Inserts a new element into the container directly before pos.
         /// @param pos iterator before which the new element will be constructed
         /// @param ...args arguments to forward to the constructor of the element
         /// @return terator pointing to the emplaced element.
         template <class... Args>
-        iterator emplace(const_iterator pos, Args&&... args);
+        iterator emplace(const_iterator pos, Args&&... args) {
+            return _insert_at(pos, [&](auto put) { put(std::forward<Args>(args)...); });
+        }
 
         /// @brief Removes the element at pos.
         /// @param pos iterator to the element to remove
         /// @return Iterator following the last removed element.
-        iterator erase(const_iterator pos);
+        iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
 
         /// @brief Removes the elements in the range [first, last).
+        /// The shorter side of the deque is moved over the gap chunk by chunk,
+        /// and chunks left empty are given back to the allocator at once, so
+        /// erasing a prefix or a suffix costs O(chunks) for trivially
+        /// destructible T.
         /// @param first,last range of elements to remove
         /// @return Iterator following the last removed element.
-        iterator erase(const_iterator first, const_iterator last);
+        iterator erase(const_iterator first, const_iterator last) {
+            difference_type before = first - cbegin();
+            difference_type count  = last - first;
+            if (count == 0) return _begin + before;
+
+            iterator from = _begin + before;
+            iterator to   = from + count;
+            if (size_type(before) < (_el_size - count) / 2) {
+                _move_backward_segments(_begin, from, to);
+                iterator new_begin = _begin + count;
+                _destroy(_begin, new_begin);
+                _deallocate_chunks(_begin._chunk_ptr, new_begin._chunk_ptr);
+                _begin = new_begin;
+            } else {
+                _move_segments(to, _end, from);
+                iterator new_end = _end - count;
+                _destroy(new_end, _end);
+                _deallocate_chunks(new_end._chunk_ptr + 1, _end._chunk_ptr + 1);
+                _end = new_end;
+            }
+            _el_size -= count;
+            return _begin + before;
+        }
 
         /// @brief Appends the given element value to the end of the container.
         /// The new element is initialized as a copy of value.
         /// @param value the value of the element to append
-        void push_back(const T& value) {
-            _el_size++;
-            if (_end._el == _end._last) {
-                if (_end._chunk_ptr == &_map[_map_capacity - 1])
-                    reallocate(_el_size);
-                else
-                    _end++;  // сюда мы входим если _end находится на ячейке сразу
-                // после НЕ ПОСЛЕДНЕГО чанка
-                *_end = value;
-                _end++;
-            }
-        }
+        void push_back(const T& value) { emplace_back(value); }
 
         /// @brief Appends the given element value to the end of the container.
         /// Value is moved into the new element.
         /// @param value the value of the element to append
-        void push_back(T&& value) {
-            _el_size++;
-            if (_end._el == _end._last) {
-                if (_end._chunk_ptr == &_map[_map_capacity - 1])
-                    reallocate(_el_size);
-                else
-                    _end++;  // сюда мы входим если _end находится на ячейке сразу
-                // после НЕ ПОСЛЕДНЕГО чанка
-                *_end = std::move(value);
-                _end++;
-            }
-        }
+        void push_back(T&& value) { emplace_back(std::move(value)); }
 
         /// @brief Appends a new element to the end of the container.
         /// @param ...args arguments to forward to the constructor of the element
         /// @return A reference to the inserted element.
         template <class... Args>
-        reference emplace_back(T&& first, Args&&... args) {
-            this->push_back(first);
-            this->emplace_back(args...);  // нужно смотреть, чтоб не зациклилось
+        reference emplace_back(Args&&... args) {
+            if (_end._el != _end._last - 1) {
+                alloc_traits::construct(_alloc_t, _end._el, std::forward<Args>(args)...);
+                _end._el++;
+            } else {
+                // _end never stays past the last cell of a chunk, so the next
+                // chunk is allocated before the last cell is filled
+                _reserve_map_back();
+                *(_end._chunk_ptr + 1) = _allocate_chunk();
+                try {
+                    alloc_traits::construct(_alloc_t, _end._el,
+                                            std::forward<Args>(args)...);
+                } catch (...) {
+                    _deallocate_chunk(*(_end._chunk_ptr + 1));
+                    throw;
+                }
+                _end._set_chunk(_end._chunk_ptr + 1);
+                _end._el = _end._first;
+            }
+            _el_size++;
             return back();
         }
 
+        /// @brief Appends count elements, each constructed in place from the
+        /// result of factory(). All the chunks are allocated first, then the
+        /// elements are built chunk by chunk in tight loops.
+        /// @param count number of elements to append
+        /// @param factory callable returning T (or something T is constructible
+        /// from); it is called count times, in order
+        template <class Factory>
+        void emplace_back_n(size_type count, Factory factory) {
+            _append_segments(count, [this, &factory](pointer from, pointer to) {
+                pointer cur = from;
+                try {
+                    for (; cur != to; cur++)
+                        ::new (static_cast<void*>(cur)) T(factory());
+                } catch (...) {
+                    _destroy_span(from, cur);
+                    throw;
+                }
+            });
+        }
+
+        /// @brief Appends copies of the elements of values, in order. The
+        /// chunks are allocated at once and each contiguous piece is copied
+        /// with a single uninitialized_copy. If a copy throws, nothing is
+        /// appended.
+        /// @param values elements to append; must not refer into this deque
+        void push_back_n(std::span<const T> values) {
+            const T* src = values.data();
+            _append_segments(values.size(), [&src](pointer from, pointer to) {
+                std::uninitialized_copy(src, src + (to - from), from);
+                src += to - from;
+            });
+        }
+
         /// @brief Removes the last element of the container.
         void pop_back() {
             if (_begin == _end) return;
-            alloc_traits::destroy(_alloc_t, &back());
+            if (_end._el == _end._first) {
+                _deallocate_chunk(_end._first);
+                _end._set_chunk(_end._chunk_ptr - 1);
+                _end._el = _end._last;
+            }
+            _end._el--;
+            alloc_traits::destroy(_alloc_t, _end._el);
             _el_size--;
-            _end--;
         }
 
         /// @brief Prepends the given element value to the beginning of the
         /// container.
         /// @param value the value of the element to prepend
-        void push_front(const T& value) {
-            _el_size++;
-            if (_begin._el == _begin._first) {
-                if (_begin._chunk_ptr == &_map[0])
-                    reallocate(_el_size);
-                else
-                    _begin--;
-                *_begin = value;
-                _begin--;
-            }
-        }
+        void push_front(const T& value) { emplace_front(value); }
 
         /// @brief Prepends the given element value to the beginning of the
         /// container.
         /// @param value moved value of the element to prepend
-        void push_front(T&& value) {
-            _el_size++;
-            if (_begin._el == _begin._first) {
-                if (_begin._chunk_ptr == &_map[0])
-                    reallocate(_el_size);
-                else
-                    _begin--;
-                *_begin = std::move(value);
-                _begin--;
-            }
-        }
+        void push_front(T&& value) { emplace_front(std::move(value)); }
 
         /// @brief Inserts a new element to the beginning of the container.
         /// @param ...args arguments to forward to the constructor of the element
         /// @return A reference to the inserted element.
         template <class... Args>
-        reference emplace_front(T&& first, Args&&... args) {
-            this->push_front(first);
-            this->template emplace_front(args...);
+        reference emplace_front(Args&&... args) {
+            if (_begin._el != _begin._first) {
+                alloc_traits::construct(_alloc_t, _begin._el - 1,
+                                        std::forward<Args>(args)...);
+                _begin._el--;
+            } else {
+                _reserve_map_front();
+                *(_begin._chunk_ptr - 1) = _allocate_chunk();
+                try {
+                    alloc_traits::construct(_alloc_t,
+                                            *(_begin._chunk_ptr - 1) + CHUNK_SIZE - 1,
+                                            std::forward<Args>(args)...);
+                } catch (...) {
+                    _deallocate_chunk(*(_begin._chunk_ptr - 1));
+                    throw;
+                }
+                _begin._set_chunk(_begin._chunk_ptr - 1);
+                _begin._el = _begin._last - 1;
+            }
+            _el_size++;
             return front();
         }
 
+        /// @brief Prepends count elements, each constructed in place from the
+        /// result of factory(). The first call builds the new front element, the
+        /// last one the element just before the old front.
+        /// @param count number of elements to prepend
+        /// @param factory callable returning T (or something T is constructible
+        /// from); it is called count times, in order
+        template <class Factory>
+        void generate_front(size_type count, Factory factory) {
+            _prepend_segments(count, [this, &factory](pointer from, pointer to) {
+                pointer cur = from;
+                try {
+                    for (; cur != to; cur++)
+                        ::new (static_cast<void*>(cur)) T(factory());
+                } catch (...) {
+                    _destroy_span(from, cur);
+                    throw;
+                }
+            });
+        }
+
+        /// @brief Prepends copies of the elements of values, keeping their
+        /// order: values.front() becomes the first element. If a copy throws,
+        /// nothing is prepended.
+        /// @param values elements to prepend; must not refer into this deque
+        void push_front_n(std::span<const T> values) {
+            const T* src = values.data();
+            _prepend_segments(values.size(), [&src](pointer from, pointer to) {
+                std::uninitialized_copy(src, src + (to - from), from);
+                src += to - from;
+            });
+        }
+
         /// @brief Removes the first element of the container.
         void pop_front() {
             if (_begin == _end) return;
-            delete *_begin;
+            alloc_traits::destroy(_alloc_t, _begin._el);
+            if (_begin._el != _begin._last - 1) {
+                _begin._el++;
+            } else {
+                _deallocate_chunk(_begin._first);
+                _begin._set_chunk(_begin._chunk_ptr + 1);
+                _begin._el = _begin._first;
+            }
             _el_size--;
-            _begin++;
+        }
+
+        /// @brief Moves the first min(n, size()) elements to out, in order, and
+        /// removes them. Each chunk is moved with one std::move call, and the
+        /// size, the front iterator and the drained chunks are updated once
+        /// for the whole batch. If a move throws, nothing is removed, but the
+        /// elements moved so far are left in their moved-from state.
+        /// @param n number of elements to pop
+        /// @param out output iterator the elements are moved to
+        /// @return Output iterator past the last element written.
+        template <class OutputIt>
+        OutputIt pop_front_n(size_type n, OutputIt out) {
+            n                  = std::min(n, _el_size);
+            iterator new_begin = _begin + difference_type(n);
+            for_each_segment(_begin, new_begin, [&out](pointer from, pointer to) {
+                out = std::move(from, to, out);
+            });
+            _destroy(_begin, new_begin);
+            _deallocate_chunks(_begin._chunk_ptr, new_begin._chunk_ptr);
+            _begin = new_begin;
+            _el_size -= n;
+            return out;
+        }
+
+        /// @brief Moves the last min(n, size()) elements to out and removes
+        /// them. The elements come out in the order repeated back() and
+        /// pop_back() calls would give, the last one first. Same batching and
+        /// exception behaviour as pop_front_n.
+        /// @param n number of elements to pop
+        /// @param out output iterator the elements are moved to
+        /// @return Output iterator past the last element written.
+        template <class OutputIt>
+        OutputIt pop_back_n(size_type n, OutputIt out) {
+            n                = std::min(n, _el_size);
+            iterator new_end = _end - difference_type(n);
+            for (chunk_ptr chunk = _end._chunk_ptr; n > 0; chunk--) {
+                pointer from = chunk == new_end._chunk_ptr ? new_end._el : *chunk;
+                pointer to   = chunk == _end._chunk_ptr ? _end._el : *chunk + CHUNK_SIZE;
+                out          = std::move(std::make_reverse_iterator(to),
+                                         std::make_reverse_iterator(from), out);
+                if (chunk == new_end._chunk_ptr) break;
+            }
+            _destroy(new_end, _end);
+            _deallocate_chunks(new_end._chunk_ptr + 1, _end._chunk_ptr + 1);
+            _el_size -= _end - new_end;
+            _end = new_end;
+            return out;
         }
 
         /// @brief Resizes the container to contain count elements.
         /// If the current size is greater than count, the container is reduced to
         /// its first count elements. If the current size is less than count,
-        /// additional default-inserted elements are appended
+        /// additional default-inserted elements are appended. The chunks for the
+        /// new elements are allocated at once and filled span by span.
         /// @param count new size of the container
-        void resize(size_type count) { resize(count, 0); }
+        void resize(size_type count) {
+            if (count > _el_size)
+                _append_segments(count - _el_size, [](pointer from, pointer to) {
+                    std::uninitialized_value_construct(from, to);
+                });
+            else if (count < _el_size)
+                erase(cbegin() + count, cend());
+        }
 
         /// @brief Resizes the container to contain count elements.
         /// If the current size is greater than count, the container is reduced to
@@ -856,9 +1629,165 @@ namespace lab {
         /// @param value the value to initialize the new elements with
         void resize(size_type count, const value_type& value) {
             if (count > _el_size)
-                while (count > _el_size) push_back(value);
+                _append_segments(count - _el_size, [&value](pointer from, pointer to) {
+                    std::uninitialized_fill(from, to, value);
+                });
             else if (count < _el_size)
-                while (count < _el_size) pop_back();
+                erase(cbegin() + count, cend());
+        }
+
+        /// @brief Rotates the elements so that the element at position k becomes
+        /// the first one, like std::rotate(begin(), begin() + k, end()).
+        /// When the size is a multiple of the chunk capacity, fewer than
+        /// 2 * CHUNK_SIZE elements are moved and the whole chunks are rotated
+        /// by pointer inside the map. Otherwise the unused slots of the first
+        /// and the last chunks have to travel through the sequence, so the
+        /// smaller side, min(k, size() - k) elements, is moved to the other end
+        /// span by span, and the chunks it leaves empty are freed together.
+        /// Invalidates all iterators.
+        /// @param k number of elements to move from the front to the back,
+        /// at most size()
+        /// @return Iterator to the element that was first, or end() if k is 0.
+        iterator rotate(size_type k) {
+            size_type rest = _el_size - k;
+            if (k == 0 || rest == 0) return k == 0 ? _end : _begin;
+            if (_el_size % CHUNK_SIZE != 0) {
+                if (k <= rest) _rotate_elements_left(k);
+                else _rotate_elements_right(rest);
+                return _begin + difference_type(rest);
+            }
+            // elements before the first chunk boundary
+            size_type head = (_begin._last - _begin._el) % CHUNK_SIZE;
+            if (k < head) {
+                _rotate_elements_left(k);
+            } else {
+                // after this _begin and _end both sit at the start of a chunk
+                _rotate_elements_left(head);
+                std::rotate(_begin._chunk_ptr,
+                            _begin._chunk_ptr + (k - head) / CHUNK_SIZE,
+                            _end._chunk_ptr);
+                _begin._set_chunk(_begin._chunk_ptr);
+                _begin._el = _begin._first;
+                _rotate_elements_left((k - head) % CHUNK_SIZE);
+            }
+            return _begin + difference_type(rest);
+        }
+
+        /// @brief Moves all the elements of other to the end of this container
+        /// and leaves other empty. When the allocators compare equal and the
+        /// front of other sits at the same offset inside its chunk as the end
+        /// of this deque, at most one chunk of elements is moved and the other
+        /// chunks of other are linked into the map by pointer, O(chunks +
+        /// CHUNK_SIZE). Otherwise the elements of the smaller deque are moved,
+        /// O(min(size(), other.size())): moving elements across the seam shifts
+        /// both offsets alike, so no partial move can line them up. They are
+        /// moved span by span into the chunks the smaller deque gives up, so
+        /// with equal allocators every chunk of both deques is kept and at most
+        /// one is allocated.
+        /// @param other container to take the elements from
+        void splice_back(Deque&& other) {
+            if (this == &other || other.empty()) return;
+            if (empty()) {
+                swap(other);
+                return;
+            }
+            if (_same_allocator(other) &&
+                _end._el - _end._first == other._begin._el - other._begin._first) {
+                _steal_chunks_back(other);
+            } else if (other._el_size <= _el_size) {
+                _move_append(other);
+            } else {
+                other._move_prepend(*this);
+                swap(other);
+            }
+            other.clear();
+        }
+
+        /// @brief Moves all the elements of other to the beginning of this
+        /// container and leaves other empty. The cost model is the same as for
+        /// splice_back, with the end of other matched against the front of
+        /// this deque.
+        /// @param other container to take the elements from
+        void splice_front(Deque&& other) {
+            if (this == &other || other.empty()) return;
+            if (empty()) {
+                swap(other);
+                return;
+            }
+            if (_same_allocator(other) &&
+                other._end._el - other._end._first == _begin._el - _begin._first) {
+                other._steal_chunks_back(*this);
+                swap(other);
+            } else if (other._el_size <= _el_size) {
+                _move_prepend(other);
+            } else {
+                other._move_append(*this);
+                swap(other);
+            }
+            other.clear();
+        }
+
+        /// @brief Removes the elements [pos, end()) from this container and
+        /// returns them as a new one. The chunks after the one holding pos are
+        /// handed over to the new deque by pointer; the elements of that chunk
+        /// from pos on are moved into a fresh chunk at the same offset, unless
+        /// pos is the first element of its chunk, in which case the chunk is
+        /// handed over as well. O(chunks + CHUNK_SIZE). Invalidates the
+        /// iterators to the elements after pos and the past-the-end iterator.
+        /// @param pos first element of the returned container
+        /// @return Container with the elements [pos, end()).
+        Deque split_at(const_iterator pos) {
+            Deque result(_alloc_t);
+            if (pos == cend()) return result;
+            if (pos == cbegin()) {
+                swap(result);
+                return result;
+            }
+            iterator cut(pos._chunk_ptr, const_cast<pointer>(pos._el));
+            size_type count  = _end - cut;
+            bool whole_chunk = cut._el == cut._first;
+            size_type chunks = _end._chunk_ptr - cut._chunk_ptr + whole_chunk;
+
+            result._reserve_map_back(chunks);
+            iterator& dest = result._end;
+            if (whole_chunk) {
+                // cut becomes our end, so it needs a chunk of its own
+                pointer empty = _allocate_chunk();
+                result._deallocate_chunk(*dest._chunk_ptr);
+                std::copy(cut._chunk_ptr, _end._chunk_ptr + 1, dest._chunk_ptr);
+                *cut._chunk_ptr = empty;
+                cut._set_chunk(cut._chunk_ptr);
+                cut._el       = cut._first;
+                result._begin = iterator(dest._chunk_ptr, *dest._chunk_ptr);
+            } else {
+                pointer from = cut._el;
+                pointer to   = chunks == 0 ? _end._el : cut._last;
+                dest._el     = dest._first + (from - cut._first);
+                std::uninitialized_move(from, to, dest._el);
+                _destroy_span(from, to);
+                std::copy(cut._chunk_ptr + 1, _end._chunk_ptr + 1, dest._chunk_ptr + 1);
+                result._begin = dest;
+            }
+            result._end     = result._begin + difference_type(count);
+            result._el_size = count;
+            _end = cut;
+            _el_size -= count;
+            return result;
+        }
+
+        /// @brief Cuts the container into k pieces of sizes that differ by at
+        /// most one, with split_at from the back. The container is left empty.
+        /// @param k number of pieces, at least 1
+        /// @return The pieces in order.
+        std::vector<Deque> split_into(size_type k) {
+            std::vector<Deque> pieces;
+            pieces.reserve(k);
+            size_type base = _el_size / k, extra = _el_size % k;
+            for (size_type i = k - 1; i > 0; i--)
+                pieces.push_back(split_at(cend() - difference_type(base + (i < extra))));
+            pieces.push_back(split_at(cbegin()));
+            std::reverse(pieces.begin(), pieces.end());
+            return pieces;
         }
 
         /// @brief Exchanges the contents of the container with those of other.
@@ -866,104 +1795,49 @@ namespace lab {
         /// elements. All iterators and references remain valid. The past-the-end
         /// iterator is invalidated.
         /// @param other container to exchange the contents with
-        void swap(Deque& other);
+        void swap(Deque& other) noexcept {
+            std::swap(_alloc_p, other._alloc_p);
+            std::swap(_alloc_t, other._alloc_t);
+            std::swap(_map, other._map);
+            std::swap(_map_capacity, other._map_capacity);
+            std::swap(_el_size, other._el_size);
+            std::swap(_begin, other._begin);
+            std::swap(_end, other._end);
+            std::swap(_spare_chunks, other._spare_chunks);
+            std::swap(_spare_count, other._spare_count);
+        }
 
         /// COMPARISIONS
 
         /// @brief Checks if the contents of lhs and rhs are equal
+        /// The deques are compared chunk span against chunk span; integral
+        /// elements are compared with memcmp.
         /// @param lhs,rhs deques whose contents to compare
-        template <class U, class Alloc>
-        friend bool operator==(const Deque<U, Alloc>& lhs,
-                               const Deque<U, Alloc>& rhs) {
-            if (lhs.size() != rhs.size()) return false;
-
-            auto lhs_iter = lhs.begin(), rhs_iter = rhs.begin();
-            while (lhs_iter != lhs.end()) {
-                if (*lhs_iter != *rhs_iter) return false;
-                lhs_iter++;
-                rhs_iter++;
-            }
-
-            return true;
+        friend bool operator==(const Deque& lhs, const Deque& rhs) {
+            return lhs.size() == rhs.size() &&
+                   _common_prefix(lhs, rhs) == lhs.size();
         }
 
         /// @brief Checks if the contents of lhs and rhs are not equal
         /// @param lhs,rhs deques whose contents to compare
-        template <class U, class Alloc>
-        friend bool operator!=(const Deque<U, Alloc>& lhs,
-                               const Deque<U, Alloc>& rhs) {
+        friend bool operator!=(const Deque& lhs, const Deque& rhs) {
             return !(lhs == rhs);
         }
 
-        /// @brief Compares the contents of lhs and rhs lexicographically.
-        /// @param lhs,rhs deques whose contents to compare
-        template <class U, class Alloc>
-        friend bool operator>(const Deque<U, Alloc>& lhs,
-                              const Deque<U, Alloc>& rhs) {
-            auto lhs_iter = lhs.begin(), rhs_iter = rhs.begin();
-            while (lhs_iter != lhs.end() && rhs_iter != rhs.end()) {
-                if (*lhs_iter < *rhs_iter)
-                    return false;
-                else if (*lhs_iter > *rhs_iter)
-                    return true;
-                lhs_iter++;
-                rhs_iter++;
-            }
-            return lhs.size() != rhs.size();
-        }
-
-        /// @brief Compares the contents of lhs and rhs lexicographically.
+        /// @brief Compares the contents of lhs and rhs lexicographically in a
+        /// single pass: the common prefix is skipped the same way as in
+        /// operator==, then only the first mismatching pair is compared.
         /// @param lhs,rhs deques whose contents to compare
-        template <class U, class Alloc>
-        friend bool operator<(const Deque<U, Alloc>& lhs,
-                              const Deque<U, Alloc>& rhs) {
-            auto lhs_iter = lhs.begin(), rhs_iter = rhs.begin();
-            while (lhs_iter != lhs.end() && rhs_iter != rhs.end()) {
-                if (*lhs_iter < *rhs_iter)
-                    return true;
-                else if (*lhs_iter > *rhs_iter)
-                    return false;
-                lhs_iter++;
-                rhs_iter++;
-            }
-            return lhs.size() != rhs.size();
-        }
-
-        /// @brief Compares the contents of lhs and rhs lexicographically.
-        /// @param lhs,rhs deques whose contents to compare
-        template <class U, class Alloc>
-        friend bool operator>=(const Deque<U, Alloc>& lhs,
-                               const Deque<U, Alloc>& rhs) {
-            auto lhs_iter = lhs.begin(), rhs_iter = rhs.begin();
-            while (lhs_iter != lhs.end() && rhs_iter != rhs.end()) {
-                if (*lhs_iter < *rhs_iter)
-                    return false;
-                else if (*lhs_iter > *rhs_iter)
-                    return true;
-                lhs_iter++;
-                rhs_iter++;
-            }
-            return lhs.size() == rhs.size();
-        }
-
-        /// @brief Compares the contents of lhs and rhs lexicographically.
-        /// @param lhs,rhs deques whose contents to compare
-        template <class U, class Alloc>
-        friend bool operator<=(const Deque<U, Alloc>& lhs,
-                               const Deque<U, Alloc>& rhs) {
-            auto lhs_iter = lhs.begin(), rhs_iter = rhs.begin();
-            while (lhs_iter != lhs.end() && rhs_iter != rhs.end()) {
-                if (*lhs_iter < *rhs_iter)
-                    return true;
-                else if (*lhs_iter > *rhs_iter)
-                    return false;
-                lhs_iter++;
-                rhs_iter++;
-            }
-            return lhs.size() == rhs.size();
-        }
-
-        // operator <=> will be handy
+        /// @return The relative order of the first pair of non-equivalent
+        /// elements, or of the sizes if one deque is a prefix of the other.
+        template <class U = T>
+        friend synth_three_way_result<U> operator<=>(const Deque& lhs,
+                                                     const Deque& rhs) {
+            size_type prefix = _common_prefix(lhs, rhs);
+            if (prefix < lhs.size() && prefix < rhs.size())
+                return synth_three_way{}(lhs[prefix], rhs[prefix]);
+            return lhs.size() <=> rhs.size();
+        }
     };
 
 /// NON-MEMBER FUNCTIONS
@@ -971,20 +1845,66 @@ namespace lab {
 /// @brief  Swaps the contents of lhs and rhs.
 /// @param lhs,rhs containers whose contents to swap
     template <class T, class Alloc>
-    void swap(Deque<T, Alloc>& lhs, Deque<T, Alloc>& rhs) {}
+    void swap(Deque<T, Alloc>& lhs, Deque<T, Alloc>& rhs) noexcept {
+        lhs.swap(rhs);
+    }
 
 /// @brief Erases all elements that compare equal to value from the container.
+/// Kept elements are compacted towards the front in one pass over the chunks
+/// and the freed tail is erased at once. For arithmetic types each batch goes
+/// to simd::remove_copy, which packs the kept lanes with a shuffle table for
+/// 4- and 8-byte types when value has the element type, and otherwise copies
+/// every element and only advances the write position for the kept ones.
 /// @param c container from which to erase
 /// @param value value to be removed
 /// @return The number of erased elements.
     template <class T, class Alloc, class U>
-    typename Deque<T, Alloc>::size_type erase(Deque<T, Alloc>& c, const U& value);
+    typename Deque<T, Alloc>::size_type erase(Deque<T, Alloc>& c, const U& value) {
+        if constexpr (std::is_arithmetic_v<T> && std::is_arithmetic_v<U>) {
+            auto old_size = c.size();
+            auto write    = c.begin();
+            for_each_segment(c.begin(), c.end(), [&](auto from, auto to) {
+                while (from != to) {
+                    // the write cursor never overtakes the read cursor, so it
+                    // only has to be moved to the next chunk between batches
+                    auto len = std::min(to - from, write._last - write._el);
+                    if constexpr (std::is_same_v<T, U>)
+                        write._el = simd::remove_copy<T>(from, from + len, write._el, value);
+                    else
+                        write._el = simd::remove_copy_scalar(from, from + len, write._el, value);
+                    from += len;
+                    if (write._el == write._last) {
+                        write._set_chunk(write._chunk_ptr + 1);
+                        write._el = write._first;
+                    }
+                }
+            });
+            c.erase(write, c.end());
+            return old_size - c.size();
+        } else {
+            return erase_if(c, [&value](const T& el) { return el == value; });
+        }
+    }
 
 /// @brief Erases all elements that compare equal to value from the container.
+/// Kept elements are moved towards the front in one pass over the chunks and
+/// the freed tail is erased at once.
 /// @param c container from which to erase
 /// @param pred unary predicate which returns ​true if the element should be
 /// erased.
 /// @return The number of erased elements.
     template <class T, class Alloc, class Pred>
-    typename Deque<T, Alloc>::size_type erase_if(Deque<T, Alloc>& c, Pred pred);
+    typename Deque<T, Alloc>::size_type erase_if(Deque<T, Alloc>& c, Pred pred) {
+        auto old_size = c.size();
+        auto write    = c.begin();
+        for_each_segment(c.begin(), c.end(), [&](auto from, auto to) {
+            for (; from != to; from++) {
+                if (pred(*from)) continue;
+                if (write._el != from) *write = std::move(*from);
+                write++;
+            }
+        });
+        c.erase(write, c.end());
+        return old_size - c.size();
+    }
 }  // namespace lab
\ No newline at end of file
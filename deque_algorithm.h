@@ -0,0 +1,255 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "deque.h"
+#include "deque_simd.h"
+
+namespace lab {
+    /// @brief Tag that allows the reductions to reorder floating point
+    /// operations. Results may then differ from a left fold in the last bits.
+    struct reassociate_t {
+        explicit reassociate_t() = default;
+    };
+    inline constexpr reassociate_t reassociate{};
+
+    template <bool Reassociate, class T, class Alloc, class BinaryOp>
+    T _reduce(const Deque<T, Alloc>& d, T init, BinaryOp op) {
+        for_each_segment(d.begin(), d.end(), [&](const T* from, const T* to) {
+            init = simd::reduce<Reassociate>(from, to, std::move(init), op);
+        });
+        return init;
+    }
+
+/// @brief Folds the elements of d into init with op, chunk by chunk. Like
+/// std::reduce, op must be associative and commutative: every chunk is
+/// reduced with several independent accumulators. Floating point elements
+/// are folded strictly left to right unless the reassociate overload is used.
+/// @param d deque to reduce
+/// @param init initial value
+/// @param op binary operation
+/// @return The reduced value.
+    template <class T, class Alloc, class BinaryOp>
+    T reduce(const Deque<T, Alloc>& d, std::type_identity_t<T> init, BinaryOp op) {
+        return _reduce<!std::is_floating_point_v<T>>(d, std::move(init), op);
+    }
+
+/// @brief Same as reduce(d, init, op), but floating point elements are
+/// reduced with several accumulators as well.
+    template <class T, class Alloc, class BinaryOp>
+    T reduce(reassociate_t, const Deque<T, Alloc>& d, std::type_identity_t<T> init,
+             BinaryOp op) {
+        return _reduce<true>(d, std::move(init), op);
+    }
+
+/// @brief Same as reduce(d, T(), op).
+    template <class T, class Alloc, class BinaryOp>
+    T reduce(const Deque<T, Alloc>& d, BinaryOp op) {
+        return reduce(d, T(), op);
+    }
+
+/// @brief Returns the sum of the elements of d, or T() if d is empty.
+    template <class T, class Alloc>
+    T sum(const Deque<T, Alloc>& d) {
+        return reduce(d, T(), std::plus<>());
+    }
+
+/// @brief Same as sum(d), with reassociation of floating point additions.
+    template <class T, class Alloc>
+    T sum(reassociate_t, const Deque<T, Alloc>& d) {
+        return reduce(reassociate, d, T(), std::plus<>());
+    }
+
+/// @brief Returns the smallest element of d. The deque must not be empty.
+    template <class T, class Alloc>
+    T min(const Deque<T, Alloc>& d) {
+        return _reduce<true>(d, d.front(), [](const T& a, const T& b) {
+            return b < a ? b : a;
+        });
+    }
+
+/// @brief Returns the largest element of d. The deque must not be empty.
+    template <class T, class Alloc>
+    T max(const Deque<T, Alloc>& d) {
+        return _reduce<true>(d, d.front(), [](const T& a, const T& b) {
+            return a < b ? b : a;
+        });
+    }
+
+/// @brief Returns the smallest and the largest elements of d in one pass.
+/// The deque must not be empty.
+    template <class T, class Alloc>
+    std::pair<T, T> minmax(const Deque<T, Alloc>& d) {
+        T lo = d.front(), hi = d.front();
+        for_each_segment(d.begin(), d.end(), [&](const T* from, const T* to) {
+            simd::minmax(from, to, lo, hi);
+        });
+        return {lo, hi};
+    }
+
+/// @brief Rotates d so that middle becomes its first element. This is the
+/// whole-container form of std::rotate(d.begin(), middle, d.end()) in the
+/// spirit of std::ranges::rotate(range, middle): a plain iterator range
+/// cannot reach the map, so std::rotate itself always moves every element,
+/// while this overload goes through Deque::rotate and moves chunk pointers.
+/// @param d deque to rotate
+/// @param middle element that becomes the first one
+/// @return Iterator to the element that was first, or d.end() if middle is
+/// d.begin().
+    template <class T, class Alloc>
+    typename Deque<T, Alloc>::iterator rotate(
+            Deque<T, Alloc>& d, typename Deque<T, Alloc>::const_iterator middle) {
+        return d.rotate(middle - d.cbegin());
+    }
+
+/// @brief Index of the head elements of the chunks of a sorted deque, kept in
+/// one contiguous array so that lookups run branchless binary searches
+/// without touching the map. The index is a snapshot: it must be rebuilt
+/// after any modification of the deque.
+    template <class T, class Alloc = Allocator<T>, class Compare = std::less<>>
+    class ChunkHeadIndex {
+    public:
+        using iterator = typename Deque<T, Alloc>::iterator;
+
+        explicit ChunkHeadIndex(Deque<T, Alloc>& d, Compare comp = Compare())
+                : _deque(&d), _comp(comp) {
+            rebuild();
+        }
+
+        /// @brief Reads the chunk heads of the deque again.
+        void rebuild() {
+            _heads.clear();
+            _spans.clear();
+            std::size_t offset = 0;
+            for_each_segment(_deque->begin(), _deque->end(), [&](T* from, T* to) {
+                if (from == to) return;
+                _heads.push_back(*from);
+                _spans.push_back({from, to, offset});
+                offset += to - from;
+            });
+        }
+
+        /// @brief Same as Deque::lower_bound(value, comp).
+        iterator lower_bound(const T& value) const {
+            return _bound([&](const T& el) { return bool(_comp(el, value)); });
+        }
+
+        /// @brief Same as Deque::upper_bound(value, comp).
+        iterator upper_bound(const T& value) const {
+            return _bound([&](const T& el) { return !bool(_comp(value, el)); });
+        }
+
+    private:
+        struct Span {
+            T* from;
+            T* to;
+            std::size_t offset;
+        };
+
+        Deque<T, Alloc>* _deque;
+        Compare _comp;
+        std::vector<T> _heads;
+        std::vector<Span> _spans;
+
+        /// @brief Returns the number of leading elements of [first, first + n)
+        /// for which before is true. The loop has a fixed trip count for a
+        /// given n and compiles to conditional moves.
+        template <class Before>
+        static std::size_t _branchless_partition_point(const T* first, std::size_t n,
+                                                       Before before) {
+            if (n == 0) return 0;
+            const T* base = first;
+            while (n > 1) {
+                std::size_t half = n / 2;
+                base = before(base[half]) ? base + half : base;
+                n -= half;
+            }
+            return base - first + before(*base);
+        }
+
+        template <class Before>
+        iterator _bound(Before before) const {
+            std::size_t next = _branchless_partition_point(_heads.data(), _heads.size(), before);
+            if (next == 0) return _deque->begin();
+            const Span& span = _spans[next - 1];
+            std::size_t found =
+                    _branchless_partition_point(span.from, span.to - span.from, before);
+            return _deque->begin() + (span.offset + found);
+        }
+    };
+
+    /// @brief Uninitialized scratch storage of the sorts, taken from a copy of
+    /// the deque's allocator through allocator_traits, so sorting needs no
+    /// default constructor and value-initializes nothing. The first size()
+    /// elements are alive and are destroyed with the buffer.
+    template <class T, class Alloc>
+    class _SortBuffer {
+        using alloc_traits = std::allocator_traits<Alloc>;
+
+    public:
+        _SortBuffer(const Alloc& alloc, std::size_t capacity)
+            : _alloc(alloc), _capacity(capacity),
+              _data(capacity ? alloc_traits::allocate(_alloc, capacity) : nullptr) {}
+
+        _SortBuffer(const _SortBuffer&)            = delete;
+        _SortBuffer& operator=(const _SortBuffer&) = delete;
+
+        ~_SortBuffer() {
+            clear();
+            if (_data) alloc_traits::deallocate(_alloc, _data, _capacity);
+        }
+
+        T* begin() const noexcept { return _data; }
+        T* end() const noexcept { return _data + _size; }
+
+        /// @brief Move-constructs [from, to) after the live elements.
+        void append(T* from, T* to) {
+            _size = std::uninitialized_move(from, to, end()) - _data;
+        }
+
+        /// @brief Marks the first size slots, constructed by the caller, as
+        /// alive.
+        void set_size(std::size_t size) noexcept { _size = size; }
+
+        void clear() noexcept {
+            std::destroy(begin(), end());
+            _size = 0;
+        }
+
+        /// Both buffers hold a copy of the same deque's allocator, so only the
+        /// storage is exchanged.
+        void swap(_SortBuffer& other) noexcept {
+            std::swap(_capacity, other._capacity);
+            std::swap(_size, other._size);
+            std::swap(_data, other._data);
+        }
+
+    private:
+        Alloc _alloc;
+        std::size_t _capacity, _size = 0;
+        T* _data;
+    };
+
+/// @brief Sorts the elements of d. The elements are move-constructed chunk by
+/// chunk into an uninitialized scratch buffer, sorted there with std::sort
+/// on raw pointers and moved back chunk by chunk, so no comparison goes
+/// through a deque iterator. This is the parallel sort with a single part.
+/// T must be move constructible and move assignable.
+/// @param d deque to sort
+/// @param comp comparison function object
+    template <class T, class Alloc, class Compare = std::less<>>
+    void sort(Deque<T, Alloc>& d, Compare comp = Compare()) {
+        _SortBuffer<T, Alloc> buffer(d.get_allocator(), d.size());
+        for_each_segment(d.begin(), d.end(), [&](T* from, T* to) { buffer.append(from, to); });
+        std::sort(buffer.begin(), buffer.end(), comp);
+        T* in = buffer.begin();
+        for_each_segment(d.begin(), d.end(), [&](T* from, T* to) {
+            std::move(in, in + (to - from), from);
+            in += to - from;
+        });
+    }
+}  // namespace lab
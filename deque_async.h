@@ -0,0 +1,253 @@
+#pragma once
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "deque.h"
+
+namespace lab {
+    /// @brief Fire-and-forget coroutine, started by Executor::spawn. Its
+    /// frame is freed when it finishes; an exception escaping it terminates
+    /// the program.
+    class Job {
+    public:
+        struct promise_type {
+            Job get_return_object() {
+                return Job(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            std::suspend_never final_suspend() noexcept { return {}; }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+
+        Job(Job&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+
+        Job& operator=(Job&& other) noexcept {
+            std::swap(_handle, other._handle);
+            return *this;
+        }
+
+        /// @brief Destroys the coroutine if it was never started.
+        ~Job() {
+            if (_handle) _handle.destroy();
+        }
+
+    private:
+        friend class Executor;
+
+        explicit Job(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+        std::coroutine_handle<promise_type> _handle;
+    };
+
+    /// @brief Single-threaded run queue of coroutines. run() resumes them in
+    /// FIFO order until none is left; it is not thread-safe.
+    class Executor {
+    public:
+        /// @brief Queues job to start at the next run().
+        void spawn(Job job) { post(std::exchange(job._handle, nullptr)); }
+
+        /// @brief Queues handle to be resumed by run().
+        void post(std::coroutine_handle<> handle) { _ready.push_back(handle); }
+
+        /// @brief Awaitable that puts the awaiting coroutine at the back of
+        /// the queue, letting the others run.
+        auto yield() {
+            struct Awaiter {
+                Executor& executor;
+
+                bool await_ready() const noexcept { return false; }
+
+                void await_suspend(std::coroutine_handle<> handle) { executor.post(handle); }
+
+                void await_resume() const noexcept {}
+            };
+            return Awaiter{*this};
+        }
+
+        /// @brief Resumes queued coroutines until the queue is empty.
+        void run() {
+            while (!_ready.empty()) {
+                std::coroutine_handle<> handle = _ready.front();
+                _ready.pop_front();
+                handle.resume();
+            }
+        }
+
+    private:
+        Deque<std::coroutine_handle<>> _ready;
+    };
+
+    /// @brief Deque for coroutines: co_await pop_front() suspends while the
+    /// deque is empty, and co_await push_back(value) suspends while a
+    /// bounded deque is full. There is no thread blocking: the thread that
+    /// supplies an element resumes the coroutine waiting for it right away,
+    /// handing the element over without going through the deque, and a pop
+    /// that makes room resumes the first waiting pusher the same way. The
+    /// resumed coroutine runs on the resuming thread, before the call that
+    /// resumed it returns.
+    ///
+    /// The deque may be used from several threads; a mutex guards the
+    /// elements and the FIFO lists of waiters, and it is never held while a
+    /// coroutine is resumed.
+    template <typename T, typename Allocator = Allocator<T>>
+    class AsyncDeque {
+        struct PopAwaiter;
+        struct PushAwaiter;
+
+    public:
+        using value_type     = T;
+        using allocator_type = Allocator;
+        using size_type      = std::size_t;
+
+        /// @param capacity most elements held, 0 for no limit
+        explicit AsyncDeque(size_type capacity = 0, const Allocator& alloc = Allocator())
+                : _items(alloc), _capacity(capacity) {}
+
+        AsyncDeque(const AsyncDeque&)            = delete;
+        AsyncDeque& operator=(const AsyncDeque&) = delete;
+
+        /// @brief Awaitable taking the first element; co_await yields it.
+        PopAwaiter pop_front() { return PopAwaiter{*this}; }
+
+        /// @brief Awaitable appending value, or handing it to a waiting
+        /// coroutine; only suspends while a bounded deque is full.
+        PushAwaiter push_back(T value) { return PushAwaiter{*this, std::move(value)}; }
+
+        /// @brief Appends value, or hands it to a waiting coroutine, without
+        /// suspending. For callers that are not coroutines.
+        /// @return false if the deque is bounded and full; value is then left
+        /// alone.
+        template <class U>
+        bool try_push_back(U&& value) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (PopAwaiter* waiter = _pop_waiters.take()) {
+                waiter->value.emplace(std::forward<U>(value));
+                lock.unlock();
+                waiter->handle.resume();
+                return true;
+            }
+            if (_capacity && _items.size() >= _capacity) return false;
+            _items.push_back(std::forward<U>(value));
+            return true;
+        }
+
+        /// @brief Moves the first element into out and removes it, if there
+        /// is one, without suspending.
+        /// @return false if the deque was empty.
+        bool try_pop_front(T& out) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_items.empty()) return false;
+            out = std::move(_items.front());
+            _take_front(lock);
+            return true;
+        }
+
+        /// @brief Returns the number of queued elements.
+        size_type size() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _items.size();
+        }
+
+        bool empty() { return size() == 0; }
+
+    private:
+        /// @brief Intrusive FIFO of awaiters, which live in the frames of the
+        /// suspended coroutines.
+        template <class Waiter>
+        struct WaitList {
+            Waiter* head = nullptr;
+            Waiter* tail = nullptr;
+
+            void put(Waiter* waiter) noexcept {
+                waiter->next = nullptr;
+                if (tail) tail->next = waiter;
+                else head = waiter;
+                tail = waiter;
+            }
+
+            Waiter* take() noexcept {
+                Waiter* waiter = head;
+                if (waiter && !(head = waiter->next)) tail = nullptr;
+                return waiter;
+            }
+        };
+
+        struct PopAwaiter {
+            AsyncDeque& deque;
+            std::optional<T> value{};
+            std::coroutine_handle<> handle{};
+            PopAwaiter* next = nullptr;
+
+            bool await_ready() const noexcept { return false; }
+
+            /// @return false to go on at once if an element was there.
+            bool await_suspend(std::coroutine_handle<> awaiting) {
+                std::unique_lock<std::mutex> lock(deque._mutex);
+                if (!deque._items.empty()) {
+                    value.emplace(std::move(deque._items.front()));
+                    deque._take_front(lock);
+                    return false;
+                }
+                handle = awaiting;
+                deque._pop_waiters.put(this);
+                return true;
+            }
+
+            T await_resume() { return std::move(*value); }
+        };
+
+        struct PushAwaiter {
+            AsyncDeque& deque;
+            T value;
+            std::coroutine_handle<> handle{};
+            PushAwaiter* next = nullptr;
+
+            bool await_ready() const noexcept { return false; }
+
+            /// @return false to go on at once unless the deque is full.
+            bool await_suspend(std::coroutine_handle<> awaiting) {
+                std::unique_lock<std::mutex> lock(deque._mutex);
+                if (PopAwaiter* waiter = deque._pop_waiters.take()) {
+                    waiter->value.emplace(std::move(value));
+                    lock.unlock();
+                    waiter->handle.resume();
+                    return false;
+                }
+                if (deque._capacity && deque._items.size() >= deque._capacity) {
+                    handle = awaiting;
+                    deque._push_waiters.put(this);
+                    return true;
+                }
+                deque._items.push_back(std::move(value));
+                return false;
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        std::mutex _mutex;
+        Deque<T, Allocator> _items;
+        size_type _capacity;
+        WaitList<PopAwaiter> _pop_waiters;
+        WaitList<PushAwaiter> _push_waiters;
+
+        /// @brief Pops the front element, whose value was already taken, lets
+        /// the first waiting pusher fill the freed place, and releases lock.
+        void _take_front(std::unique_lock<std::mutex>& lock) {
+            _items.pop_front();
+            PushAwaiter* pusher = _push_waiters.take();
+            if (pusher) _items.push_back(std::move(pusher->value));
+            lock.unlock();
+            if (pusher) pusher->handle.resume();
+        }
+    };
+}  // namespace lab
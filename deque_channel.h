@@ -0,0 +1,259 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "deque.h"
+#include "deque_simd.h"
+
+namespace lab {
+    /// @brief How a Channel waits for room or for an element: it spins on a
+    /// lock-free snapshot of the channel state first, then parks on a
+    /// condition variable.
+    struct WaitPolicy {
+        /// most pause iterations before parking; 0 parks right away
+        unsigned max_spins = 2000;
+        /// spin up to about twice the recent successful spin count rather
+        /// than always up to max_spins, so that when waits keep ending up
+        /// parked anyway the spinning fades out
+        bool adaptive = true;
+    };
+
+    /// @brief Bounded multi-producer multi-consumer channel over a Deque.
+    /// The capacity is a whole number of chunks. push() blocks while the
+    /// channel is full and pop() while it is empty; both spin first, as
+    /// WaitPolicy says, and then sleep until the other side signals them,
+    /// which it only does when someone is actually sleeping.
+    ///
+    /// close() ends the stream: pushes fail from then on, pops still take
+    /// the elements left and fail once the channel is drained, and every
+    /// waiting thread is woken.
+    template <typename T, typename Allocator = Allocator<T>>
+    class Channel {
+    public:
+        using value_type     = T;
+        using allocator_type = Allocator;
+        using size_type      = std::size_t;
+        using clock          = std::chrono::steady_clock;
+
+        const static size_type CHUNK_SIZE =
+                512 / sizeof(T) == 0 ? 1 : 512 / sizeof(T);
+
+        /// @param chunks capacity in chunks of CHUNK_SIZE elements, at least 1
+        /// @param wait spinning before the threads park
+        explicit Channel(size_type chunks, WaitPolicy wait = WaitPolicy(),
+                         const Allocator& alloc = Allocator())
+                : _items(alloc),
+                  _capacity(std::max(chunks, size_type(1)) * CHUNK_SIZE),
+                  _wait(wait),
+                  _spins(int(wait.max_spins / 2)) {}
+
+        Channel(const Channel&)            = delete;
+        Channel& operator=(const Channel&) = delete;
+
+        /// @brief Appends value, waiting while the channel is full.
+        /// @return false if the channel is closed; value is then left alone.
+        bool push(const T& value) { return _push(value, nullptr); }
+
+        bool push(T&& value) { return _push(std::move(value), nullptr); }
+
+        /// @brief Appends value if there is room right now.
+        /// @return false if the channel is full or closed.
+        bool try_push(const T& value) { return _try_push(value); }
+
+        bool try_push(T&& value) { return _try_push(std::move(value)); }
+
+        /// @brief Same as push, but gives up after timeout.
+        /// @return false if the channel is closed or still full at the
+        /// deadline.
+        template <class U, class Rep, class Period>
+        bool push_for(U&& value, const std::chrono::duration<Rep, Period>& timeout) {
+            clock::time_point deadline = clock::now() + timeout;
+            return _push(std::forward<U>(value), &deadline);
+        }
+
+        /// @brief Moves the first element into out and removes it, waiting
+        /// while the channel is empty and open.
+        /// @return false once the channel is closed and drained.
+        bool pop(T& out) { return _pop(out, nullptr); }
+
+        /// @brief Takes the first element if there is one right now.
+        /// @return false if the channel is empty.
+        bool try_pop(T& out) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_items.empty()) return false;
+            _take(lock, out);
+            return true;
+        }
+
+        /// @brief Same as pop, but gives up after timeout.
+        /// @return false if the channel is empty at the deadline, or closed
+        /// and drained.
+        template <class Rep, class Period>
+        bool pop_for(T& out, const std::chrono::duration<Rep, Period>& timeout) {
+            clock::time_point deadline = clock::now() + timeout;
+            return _pop(out, &deadline);
+        }
+
+        /// @brief Moves every element queued right now to out, in order,
+        /// without waiting, and wakes the blocked producers. Meant for the
+        /// consumer side of shutdown: after close(), drain() returns the
+        /// rest of the stream in one batch.
+        /// @return Output iterator past the last element written.
+        template <class OutputIt>
+        OutputIt drain(OutputIt out) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            out = _items.pop_front_n(_items.size(), out);
+            _size.store(0, std::memory_order_relaxed);
+            bool wake = _push_waiters > 0;
+            lock.unlock();
+            if (wake) _not_full.notify_all();
+            return out;
+        }
+
+        /// @brief Closes the channel and wakes all the waiting threads.
+        void close() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _closed.store(true, std::memory_order_relaxed);
+            }
+            _not_full.notify_all();
+            _not_empty.notify_all();
+        }
+
+        bool closed() const noexcept { return _closed.load(std::memory_order_relaxed); }
+
+        /// @brief Returns a snapshot of the number of queued elements.
+        size_type size() const noexcept { return _size.load(std::memory_order_relaxed); }
+
+        bool empty() const noexcept { return size() == 0; }
+
+        /// @brief Returns the most elements the channel holds.
+        size_type capacity() const noexcept { return _capacity; }
+
+    private:
+        std::mutex _mutex;
+        Deque<T, Allocator> _items;
+        const size_type _capacity;
+        const WaitPolicy _wait;
+        // written under _mutex, read without it while spinning
+        std::atomic<size_type> _size{0};
+        std::atomic<bool> _closed{false};
+        std::atomic<int> _spins;  // running average of successful spins
+
+        std::condition_variable _not_full, _not_empty;
+        unsigned _push_waiters = 0, _pop_waiters = 0;  // under _mutex
+
+        static void _cpu_relax() noexcept {
+#ifdef LAB_DEQUE_X86_SIMD
+            _mm_pause();
+#else
+            std::this_thread::yield();
+#endif
+        }
+
+        /// @brief Spins until hint() returns true or the spin budget runs
+        /// out. hint() reads the lock-free snapshot, so it may be wrong
+        /// either way; the caller checks again under the lock.
+        template <class Hint>
+        void _spin(Hint hint) {
+            if (hint()) return;
+            unsigned limit = _wait.max_spins;
+            if (_wait.adaptive)
+                limit = std::min(limit, 2 * unsigned(_spins.load(std::memory_order_relaxed)) + 10);
+            unsigned spins = 0;
+            while (spins < limit && !hint()) {
+                _cpu_relax();
+                spins++;
+            }
+            if (_wait.adaptive) {
+                // a spin that ended in success pulls the average towards its
+                // length, one that ran out pulls it towards zero
+                int average = _spins.load(std::memory_order_relaxed);
+                int target  = spins < limit ? int(spins) : 0;
+                _spins.store(average + (target - average) / 8, std::memory_order_relaxed);
+            }
+        }
+
+        /// @brief Spins, then takes lock and sleeps on cv until ready() holds
+        /// or the deadline, if any, passes. Returns with lock held.
+        /// @return ready() at the time of return.
+        template <class Ready>
+        bool _wait_until(std::unique_lock<std::mutex>& lock, std::condition_variable& cv,
+                         unsigned& waiters, const clock::time_point* deadline,
+                         Ready ready) {
+            _spin(ready);
+            lock.lock();
+            while (!ready()) {
+                waiters++;
+                bool timed_out = false;
+                if (deadline) timed_out = cv.wait_until(lock, *deadline) == std::cv_status::timeout;
+                else cv.wait(lock);
+                waiters--;
+                if (timed_out) return ready();
+            }
+            return true;
+        }
+
+        template <class U>
+        bool _push(U&& value, const clock::time_point* deadline) {
+            std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+            // size and closed are exact under the lock, which is all the
+            // final check needs
+            if (!_wait_until(lock, _not_full, _push_waiters, deadline, [this] {
+                    return _closed.load(std::memory_order_relaxed) ||
+                           _size.load(std::memory_order_relaxed) < _capacity;
+                }) ||
+                _closed.load(std::memory_order_relaxed))
+                return false;
+            _put(lock, std::forward<U>(value));
+            return true;
+        }
+
+        template <class U>
+        bool _try_push(U&& value) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_closed.load(std::memory_order_relaxed) || _items.size() >= _capacity)
+                return false;
+            _put(lock, std::forward<U>(value));
+            return true;
+        }
+
+        bool _pop(T& out, const clock::time_point* deadline) {
+            std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+            _wait_until(lock, _not_empty, _pop_waiters, deadline, [this] {
+                return _closed.load(std::memory_order_relaxed) ||
+                       _size.load(std::memory_order_relaxed) > 0;
+            });
+            if (_items.empty()) return false;
+            _take(lock, out);
+            return true;
+        }
+
+        /// @brief Appends value under lock, then releases lock and wakes a
+        /// consumer if one is asleep.
+        template <class U>
+        void _put(std::unique_lock<std::mutex>& lock, U&& value) {
+            _items.push_back(std::forward<U>(value));
+            _size.store(_items.size(), std::memory_order_relaxed);
+            bool wake = _pop_waiters > 0;
+            lock.unlock();
+            if (wake) _not_empty.notify_one();
+        }
+
+        /// @brief Same as _put, for taking the first element.
+        void _take(std::unique_lock<std::mutex>& lock, T& out) {
+            out = std::move(_items.front());
+            _items.pop_front();
+            _size.store(_items.size(), std::memory_order_relaxed);
+            bool wake = _push_waiters > 0;
+            lock.unlock();
+            if (wake) _not_full.notify_one();
+        }
+    };
+}  // namespace lab
@@ -0,0 +1,488 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <utility>
+
+#include "deque.h"
+
+namespace lab {
+    /// @brief Thread-safe deque for any number of threads pushing and popping
+    /// at both ends. Every element has a fixed logical index; the front and
+    /// the back each have their own mutex and publish their index, pushes
+    /// with a release store and pops with a sequentially consistent one. An
+    /// end only takes the other end's lock when it pops
+    /// from a deque it sees holding fewer than two elements, the one case in
+    /// which both ends could reach the same element.
+    ///
+    /// Storage is the chunked layout of Deque: CHUNK_SIZE elements per chunk
+    /// and a map of chunk pointers, used here as a ring indexed by the chunk
+    /// number. Each end keeps one spare chunk, so crossing a chunk boundary
+    /// back and forth does not allocate; new chunks are allocated and the map
+    /// is grown with the end's lock released.
+    template <typename T, typename Allocator = Allocator<T>>
+    class ConcurrentDeque {
+    public:
+        using value_type     = T;
+        using allocator_type = Allocator;
+        using size_type      = std::size_t;
+        using pointer        = typename std::allocator_traits<Allocator>::pointer;
+
+        const static size_type CHUNK_SIZE =
+                512 / sizeof(T) == 0 ? 1 : 512 / sizeof(T);
+
+        explicit ConcurrentDeque(const Allocator& alloc = Allocator())
+                : _alloc_t(alloc), _alloc_p(alloc) {
+            _map_capacity = 8;
+            _map          = _alloc_p.allocate(_map_capacity);
+            // far from 0 so that the indices never wrap at the front
+            size_type start = (size_type(1) << (sizeof(size_type) * 8 - 2)) /
+                              CHUNK_SIZE * CHUNK_SIZE + CHUNK_SIZE / 2;
+            _chunk(start / CHUNK_SIZE) = _alloc_t.allocate(CHUNK_SIZE);
+            _head.store(start, std::memory_order_relaxed);
+            _tail.store(start, std::memory_order_relaxed);
+        }
+
+        ConcurrentDeque(const ConcurrentDeque&)            = delete;
+        ConcurrentDeque& operator=(const ConcurrentDeque&) = delete;
+
+        /// @brief Destroys the elements and frees all the memory. No thread may
+        /// use the deque any more.
+        ~ConcurrentDeque() {
+            size_type head = _head.load(), tail = _tail.load();
+            for (size_type i = head; i != tail; i++) std::destroy_at(_element(i));
+            for (size_type c = head / CHUNK_SIZE; c <= tail / CHUNK_SIZE; c++)
+                _alloc_t.deallocate(_chunk(c), CHUNK_SIZE);
+            if (_front_spare) _alloc_t.deallocate(_front_spare, CHUNK_SIZE);
+            if (_back_spare) _alloc_t.deallocate(_back_spare, CHUNK_SIZE);
+            _alloc_p.deallocate(_map, _map_capacity);
+        }
+
+        /// @brief Appends a new element constructed from args.
+        template <class... Args>
+        void emplace_back(Args&&... args) {
+            std::unique_lock<std::mutex> lock(_back_mutex);
+            size_type tail;
+            // the new end will start a chunk, which must exist beforehand
+            while ((tail = _tail.load(std::memory_order_relaxed)) % CHUNK_SIZE ==
+                           CHUNK_SIZE - 1 &&
+                   !_prepare_chunk(lock, _back_spare,
+                                   (tail + 1) / CHUNK_SIZE -
+                                           _head.load(std::memory_order_acquire) /
+                                                   CHUNK_SIZE)) {}
+            ::new (static_cast<void*>(_element(tail))) T(std::forward<Args>(args)...);
+            if (tail % CHUNK_SIZE == CHUNK_SIZE - 1) {
+                _chunk(tail / CHUNK_SIZE + 1) = _back_spare;
+                _back_spare                   = nullptr;
+            }
+            _tail.store(tail + 1, std::memory_order_release);
+        }
+
+        /// @brief Prepends a new element constructed from args.
+        template <class... Args>
+        void emplace_front(Args&&... args) {
+            std::unique_lock<std::mutex> lock(_front_mutex);
+            size_type head;
+            while ((head = _head.load(std::memory_order_relaxed)) % CHUNK_SIZE == 0 &&
+                   !_prepare_chunk(lock, _front_spare,
+                                   _tail.load(std::memory_order_acquire) / CHUNK_SIZE -
+                                           (head - 1) / CHUNK_SIZE)) {}
+            if (head % CHUNK_SIZE == 0) {
+                _chunk((head - 1) / CHUNK_SIZE) = _front_spare;
+                _front_spare                    = nullptr;
+            }
+            try {
+                ::new (static_cast<void*>(_element(head - 1)))
+                        T(std::forward<Args>(args)...);
+            } catch (...) {
+                if (head % CHUNK_SIZE == 0) _front_spare = _chunk((head - 1) / CHUNK_SIZE);
+                throw;
+            }
+            _head.store(head - 1, std::memory_order_release);
+        }
+
+        void push_back(const T& value) { emplace_back(value); }
+
+        void push_back(T&& value) { emplace_back(std::move(value)); }
+
+        void push_front(const T& value) { emplace_front(value); }
+
+        void push_front(T&& value) { emplace_front(std::move(value)); }
+
+        /// @brief Appends copies of the elements of values, in order, under a
+        /// single acquisition of the back lock; the new tail is published once
+        /// per chunk rather than once per element. The chunks the batch needs
+        /// beyond the back spare are allocated, and the map is grown to hold
+        /// them, before the first element is built, so other threads pushing
+        /// at the back cannot interleave with the batch. The one exception is a front end that
+        /// grows meanwhile far enough to need a larger map: the lock is then
+        /// released to grow it, with the elements so far already published.
+        /// If a copy throws, the elements before it stay in the deque.
+        void push_back_n(std::span<const T> values) {
+            size_type n    = values.size();
+            pointer chunks = nullptr;
+            std::unique_lock<std::mutex> lock(_back_mutex);
+            _reserve_batch(
+                    lock, _back_spare, chunks,
+                    [&] {
+                        size_type tail = _tail.load(std::memory_order_relaxed);
+                        return (tail + n) / CHUNK_SIZE - tail / CHUNK_SIZE;
+                    },
+                    [&] {
+                        return (_tail.load(std::memory_order_relaxed) + n) / CHUNK_SIZE -
+                               _head.load(std::memory_order_acquire) / CHUNK_SIZE;
+                    });
+            size_type tail = _tail.load(std::memory_order_relaxed);
+            try {
+                for (size_type i = 0; i < n;) {
+                    if (tail % CHUNK_SIZE == CHUNK_SIZE - 1 &&
+                        (tail + 1) / CHUNK_SIZE -
+                                        _head.load(std::memory_order_acquire) / CHUNK_SIZE +
+                                        2 >
+                                _map_capacity) {
+                        _tail.store(tail, std::memory_order_release);
+                        lock.unlock();
+                        _grow_map();
+                        lock.lock();
+                        tail = _tail.load(std::memory_order_relaxed);
+                        continue;
+                    }
+                    pointer next =
+                            tail % CHUNK_SIZE == CHUNK_SIZE - 1 ? _take_chunk(chunks) : nullptr;
+                    try {
+                        ::new (static_cast<void*>(_element(tail))) T(values[i]);
+                    } catch (...) {
+                        if (next) _link_chunk(chunks, next);
+                        throw;
+                    }
+                    if (next) {
+                        _chunk(tail / CHUNK_SIZE + 1) = next;
+                        _tail.store(tail + 1, std::memory_order_release);
+                    }
+                    tail++;
+                    i++;
+                }
+            } catch (...) {
+                _tail.store(tail, std::memory_order_release);
+                lock.unlock();
+                _free_chunks(chunks);
+                throw;
+            }
+            _tail.store(tail, std::memory_order_release);
+            if (!_back_spare && chunks) _back_spare = _take_chunk(chunks);
+            lock.unlock();
+            _free_chunks(chunks);
+        }
+
+        /// @brief Prepends copies of the elements of values, keeping their
+        /// order, so values.front() becomes the first element. Same locking
+        /// and exception behaviour as push_back_n; the elements are built
+        /// from the last one to the first.
+        void push_front_n(std::span<const T> values) {
+            size_type n    = values.size();
+            pointer chunks = nullptr;
+            std::unique_lock<std::mutex> lock(_front_mutex);
+            _reserve_batch(
+                    lock, _front_spare, chunks,
+                    [&] {
+                        size_type head = _head.load(std::memory_order_relaxed);
+                        return head / CHUNK_SIZE - (head - n) / CHUNK_SIZE;
+                    },
+                    [&] {
+                        return _tail.load(std::memory_order_acquire) / CHUNK_SIZE -
+                               (_head.load(std::memory_order_relaxed) - n) / CHUNK_SIZE;
+                    });
+            size_type head = _head.load(std::memory_order_relaxed);
+            try {
+                for (size_type i = n; i > 0;) {
+                    if (head % CHUNK_SIZE == 0) {
+                        if (_tail.load(std::memory_order_acquire) / CHUNK_SIZE -
+                                    (head - 1) / CHUNK_SIZE + 2 >
+                            _map_capacity) {
+                            _head.store(head, std::memory_order_release);
+                            lock.unlock();
+                            _grow_map();
+                            lock.lock();
+                            head = _head.load(std::memory_order_relaxed);
+                            continue;
+                        }
+                        _chunk((head - 1) / CHUNK_SIZE) = _take_chunk(chunks);
+                        try {
+                            ::new (static_cast<void*>(_element(head - 1))) T(values[i - 1]);
+                        } catch (...) {
+                            _link_chunk(chunks, _chunk((head - 1) / CHUNK_SIZE));
+                            throw;
+                        }
+                        _head.store(head - 1, std::memory_order_release);
+                    } else {
+                        ::new (static_cast<void*>(_element(head - 1))) T(values[i - 1]);
+                    }
+                    head--;
+                    i--;
+                }
+            } catch (...) {
+                _head.store(head, std::memory_order_release);
+                lock.unlock();
+                _free_chunks(chunks);
+                throw;
+            }
+            _head.store(head, std::memory_order_release);
+            if (!_front_spare && chunks) _front_spare = _take_chunk(chunks);
+            lock.unlock();
+            _free_chunks(chunks);
+        }
+
+        /// @brief Moves the first element into out and removes it, if there is
+        /// one.
+        /// @return false if the deque was empty.
+        bool try_pop_front(T& out) { return pop_front_n(1, &out) != &out; }
+
+        /// @brief Moves the last element into out and removes it, if there is
+        /// one.
+        /// @return false if the deque was empty.
+        bool try_pop_back(T& out) { return pop_back_n(1, &out) != &out; }
+
+        /// @brief Moves up to n elements from the front to out, in order, and
+        /// removes them, under a single acquisition of the front lock. The
+        /// elements are still popped and published one at a time, so that the
+        /// back end sees each one go; once fewer than two are left, the rest
+        /// of the batch is popped with both locks held. Drained chunks are
+        /// freed after the locks are released.
+        /// @return Output iterator past the last element written.
+        template <class OutputIt>
+        OutputIt pop_front_n(size_type n, OutputIt out) {
+            pointer drained = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(_front_mutex);
+                size_type popped = _pop_front_n(n, out, drained, 1);
+                if (popped < n) {
+                    lock.unlock();
+                    std::scoped_lock both(_front_mutex, _back_mutex);
+                    _pop_front_n(n - popped, out, drained, 0);
+                }
+            }
+            _free_chunks(drained);
+            return out;
+        }
+
+        /// @brief Moves up to n elements from the back to out, the last one
+        /// first, and removes them. Same locking as pop_front_n.
+        /// @return Output iterator past the last element written.
+        template <class OutputIt>
+        OutputIt pop_back_n(size_type n, OutputIt out) {
+            pointer drained = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(_back_mutex);
+                size_type popped = _pop_back_n(n, out, drained, 1);
+                if (popped < n) {
+                    lock.unlock();
+                    std::scoped_lock both(_front_mutex, _back_mutex);
+                    _pop_back_n(n - popped, out, drained, 0);
+                }
+            }
+            _free_chunks(drained);
+            return out;
+        }
+
+        /// @brief Returns a snapshot of the number of elements.
+        size_type size() const noexcept {
+            size_type head = _head.load(std::memory_order_acquire);
+            size_type tail = _tail.load(std::memory_order_acquire);
+            return tail > head ? tail - head : 0;
+        }
+
+        bool empty() const noexcept { return size() == 0; }
+
+    private:
+        using allocator_pointer =
+                typename std::allocator_traits<Allocator>::template rebind_alloc<pointer>;
+
+        allocator_type _alloc_t;
+        allocator_pointer _alloc_p;
+        // ring of chunk pointers, slot = chunk number % _map_capacity; a power
+        // of two, read under either lock and replaced under both
+        pointer* _map;
+        size_type _map_capacity;
+
+        // each end on cache lines of its own, apart from the read-mostly map
+        // above; pops still read the other end's index afresh every time,
+        // since a stale copy could let both ends take the same element
+        alignas(CACHE_LINE_SIZE) std::mutex _front_mutex;
+        std::atomic<size_type> _head;
+        pointer _front_spare = nullptr;
+
+        alignas(CACHE_LINE_SIZE) std::mutex _back_mutex;
+        std::atomic<size_type> _tail;
+        pointer _back_spare = nullptr;
+
+        pointer& _chunk(size_type number) noexcept {
+            return _map[number & (_map_capacity - 1)];
+        }
+
+        T* _element(size_type index) noexcept {
+            return std::addressof(_chunk(index / CHUNK_SIZE)[index % CHUNK_SIZE]);
+        }
+
+        /// @brief Makes sure the end holding lock has a spare chunk and that
+        /// the map has room for span + 1 chunks, plus one more for the other
+        /// end, which may be claiming a chunk at the same time. Allocations
+        /// happen with lock released.
+        /// @param span distance between the first and the last chunk in use
+        /// after the new chunk is claimed
+        /// @return true if everything was ready and lock was held all along;
+        /// false if lock was released, and the caller must look again.
+        bool _prepare_chunk(std::unique_lock<std::mutex>& lock, pointer& spare,
+                            size_type span) {
+            if (!spare) {
+                lock.unlock();
+                pointer chunk = _alloc_t.allocate(CHUNK_SIZE);
+                lock.lock();
+                if (spare) _alloc_t.deallocate(chunk, CHUNK_SIZE);
+                else spare = chunk;
+                return false;
+            }
+            if (span + 2 > _map_capacity) {
+                lock.unlock();
+                _grow_map();
+                lock.lock();
+                return false;
+            }
+            return true;
+        }
+
+        /// @brief Gathers on list the chunks a batch at the end holding lock
+        /// needs beyond spare, chunks() being the number of chunk boundaries
+        /// the batch crosses, and grows the map until span() + 2 chunks fit.
+        /// Only the shortfall is allocated, with lock released; both are then
+        /// evaluated again, as the end may have moved meanwhile. Finally spare
+        /// joins list, to be used first.
+        template <class Chunks, class Span>
+        void _reserve_batch(std::unique_lock<std::mutex>& lock, pointer& spare,
+                            pointer& list, Chunks chunks, Span span) {
+            size_type gathered = 0;
+            try {
+                for (;;) {
+                    size_type needed = chunks(), held = gathered + (spare ? 1 : 0);
+                    if (held < needed) {
+                        lock.unlock();
+                        for (; held < needed; held++, gathered++)
+                            _link_chunk(list, _alloc_t.allocate(CHUNK_SIZE));
+                        lock.lock();
+                    } else if (span() + 2 > _map_capacity) {
+                        lock.unlock();
+                        _grow_map();
+                        lock.lock();
+                    } else {
+                        break;
+                    }
+                }
+            } catch (...) {
+                _free_chunks(list);
+                list = nullptr;
+                throw;
+            }
+            if (spare) {
+                _link_chunk(list, spare);
+                spare = nullptr;
+            }
+        }
+
+        /// @brief Puts chunk on the front of list, a chain of unused chunks
+        /// linked through their first bytes.
+        static void _link_chunk(pointer& list, pointer chunk) noexcept {
+            ::new (static_cast<void*>(chunk)) pointer(list);
+            list = chunk;
+        }
+
+        /// @brief Takes a chunk off list, or allocates one if list is empty.
+        pointer _take_chunk(pointer& list) {
+            if (!list) return _alloc_t.allocate(CHUNK_SIZE);
+            pointer chunk = list;
+            list          = *std::launder(reinterpret_cast<pointer*>(chunk));
+            return chunk;
+        }
+
+        void _free_chunks(pointer list) noexcept {
+            while (list) {
+                pointer chunk = list;
+                list          = *std::launder(reinterpret_cast<pointer*>(chunk));
+                _alloc_t.deallocate(chunk, CHUNK_SIZE);
+            }
+        }
+
+        /// @brief Doubles the map. The new map is allocated and the old one
+        /// freed outside of the locks; only the copy of the chunk pointers
+        /// runs with both ends locked.
+        void _grow_map() {
+            size_type capacity;
+            {
+                std::scoped_lock both(_front_mutex, _back_mutex);
+                capacity = _map_capacity;
+            }
+            pointer* new_map = _alloc_p.allocate(2 * capacity);
+            pointer* old_map = new_map;
+            {
+                std::scoped_lock both(_front_mutex, _back_mutex);
+                if (_map_capacity == capacity) {
+                    size_type first = _head.load(std::memory_order_relaxed) / CHUNK_SIZE;
+                    size_type last  = _tail.load(std::memory_order_relaxed) / CHUNK_SIZE;
+                    for (size_type c = first; c <= last; c++)
+                        new_map[c & (2 * capacity - 1)] = _chunk(c);
+                    old_map       = _map;
+                    _map          = new_map;
+                    _map_capacity = 2 * capacity;
+                }
+            }
+            _alloc_p.deallocate(old_map, old_map == new_map ? 2 * capacity : capacity);
+        }
+
+        /// @brief Pops elements from the front into out, one by one, until n
+        /// are popped or no more than keep are left. With keep = 1 only the
+        /// front lock is needed; with keep = 0 both locks must be held.
+        /// Each pop publishes the new head and then reads the tail with
+        /// sequentially consistent operations, and the back does the same the
+        /// other way: of two threads popping at both ends, at least one sees
+        /// the other's last pop and backs off to the locked path. Drained
+        /// chunks refill the spare slot first and are linked into drained
+        /// after that. If a move throws, the element stays in the deque.
+        /// @return Number of elements popped.
+        template <class OutputIt>
+        size_type _pop_front_n(size_type n, OutputIt& out, pointer& drained, size_type keep) {
+            size_type head = _head.load(std::memory_order_relaxed);
+            size_type done = 0;
+            for (; done < n && _tail.load() - head > keep; done++, head++) {
+                T* el  = _element(head);
+                *out++ = std::move(*el);
+                std::destroy_at(el);
+                if ((head + 1) % CHUNK_SIZE == 0) {
+                    if (!_front_spare) _front_spare = _chunk(head / CHUNK_SIZE);
+                    else _link_chunk(drained, _chunk(head / CHUNK_SIZE));
+                }
+                _head.store(head + 1);
+            }
+            return done;
+        }
+
+        /// @brief Same as _pop_front_n, for the back.
+        template <class OutputIt>
+        size_type _pop_back_n(size_type n, OutputIt& out, pointer& drained, size_type keep) {
+            size_type tail = _tail.load(std::memory_order_relaxed);
+            size_type done = 0;
+            for (; done < n && tail - _head.load() > keep; done++, tail--) {
+                T* el  = _element(tail - 1);
+                *out++ = std::move(*el);
+                std::destroy_at(el);
+                if (tail % CHUNK_SIZE == 0) {
+                    if (!_back_spare) _back_spare = _chunk(tail / CHUNK_SIZE);
+                    else _link_chunk(drained, _chunk(tail / CHUNK_SIZE));
+                }
+                _tail.store(tail - 1);
+            }
+            return done;
+        }
+    };
+}  // namespace lab
@@ -0,0 +1,356 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "deque.h"
+
+namespace lab {
+    /// @brief Deque for one writer thread and any number of reader threads.
+    /// The writer appends at the back and pops at the front; readers take a
+    /// Snapshot, which is the published begin and end indices, the chunk map
+    /// and an epoch, and iterate it without locks while the writer goes on.
+    ///
+    /// Storage is the chunked layout of Deque, with every element at a fixed
+    /// index. Nothing a snapshot can reach is changed in place: pop_front
+    /// only moves the published begin, and a chunk is retired as a whole
+    /// once begin leaves it, elements included. A full map is copied into a
+    /// new one that is published with one store, and the old map is retired,
+    /// RCU-style. Retired chunks and maps are tagged with the epoch they were
+    /// retired in and freed once every reader that could still see them has
+    /// dropped its snapshot. At most READER_SLOTS snapshots exist at a time;
+    /// taking one more waits for one to be dropped.
+    template <typename T, typename Allocator = Allocator<T>>
+    class EpochDeque {
+        struct Map;
+
+    public:
+        using value_type     = T;
+        using allocator_type = Allocator;
+        using size_type      = std::size_t;
+        using pointer        = typename std::allocator_traits<Allocator>::pointer;
+
+        const static size_type CHUNK_SIZE =
+                512 / sizeof(T) == 0 ? 1 : 512 / sizeof(T);
+        const static size_type READER_SLOTS = 64;
+
+        /// @brief Consistent view of the elements published when it was
+        /// taken. Holds back the reclamation of everything it can reach, so
+        /// it should not be kept longer than needed.
+        class Snapshot {
+        public:
+            class const_iterator {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type        = T;
+                using difference_type   = std::ptrdiff_t;
+                using pointer           = const T*;
+                using reference         = const T&;
+
+                const_iterator() = default;
+
+                reference operator*() const { return _map->element(_index); }
+
+                pointer operator->() const { return std::addressof(**this); }
+
+                const_iterator& operator++() {
+                    _index++;
+                    return *this;
+                }
+
+                const_iterator operator++(int) {
+                    const_iterator old = *this;
+                    _index++;
+                    return old;
+                }
+
+                friend bool operator==(const const_iterator& lhs, const const_iterator& rhs) {
+                    return lhs._index == rhs._index;
+                }
+
+            private:
+                friend class Snapshot;
+
+                const_iterator(const Map* map, size_type index) : _map(map), _index(index) {}
+
+                const Map* _map    = nullptr;
+                size_type _index   = 0;
+            };
+
+            Snapshot(Snapshot&& other) noexcept
+                    : _slot(std::exchange(other._slot, nullptr)),
+                      _map(other._map),
+                      _begin(other._begin),
+                      _end(other._end) {}
+
+            Snapshot& operator=(Snapshot&& other) noexcept {
+                std::swap(_slot, other._slot);
+                _map   = other._map;
+                _begin = other._begin;
+                _end   = other._end;
+                return *this;
+            }
+
+            /// @brief Leaves the epoch, letting the writer free what only this
+            /// snapshot could see.
+            ~Snapshot() {
+                if (_slot) _slot->store(0, std::memory_order_release);
+            }
+
+            size_type size() const noexcept { return _end - _begin; }
+
+            bool empty() const noexcept { return _begin == _end; }
+
+            const T& operator[](size_type pos) const { return _map->element(_begin + pos); }
+
+            const_iterator begin() const { return const_iterator(_map, _begin); }
+
+            const_iterator end() const { return const_iterator(_map, _end); }
+
+            /// @brief Calls fn(first, last) with raw pointers for every
+            /// contiguous part of the snapshot, front to back.
+            template <class Fn>
+            void for_each_segment(Fn fn) const {
+                for (size_type i = _begin; i < _end;) {
+                    size_type len = std::min(_end - i, CHUNK_SIZE - i % CHUNK_SIZE);
+                    const T* from = std::addressof(_map->element(i));
+                    fn(from, from + len);
+                    i += len;
+                }
+            }
+
+        private:
+            friend class EpochDeque;
+
+            Snapshot(std::atomic<std::uint64_t>* slot, const Map* map, size_type begin,
+                     size_type end)
+                    : _slot(slot), _map(map), _begin(begin), _end(end) {}
+
+            std::atomic<std::uint64_t>* _slot;
+            const Map* _map;
+            size_type _begin, _end;
+        };
+
+        explicit EpochDeque(const Allocator& alloc = Allocator())
+                : _alloc_t(alloc), _alloc_p(alloc) {
+            _map_local = _new_map(0, 8);
+            _map.store(_map_local, std::memory_order_relaxed);
+        }
+
+        EpochDeque(const EpochDeque&)            = delete;
+        EpochDeque& operator=(const EpochDeque&) = delete;
+
+        /// @brief Destroys everything. No snapshot may be alive.
+        ~EpochDeque() {
+            _reclaim(true);
+            // the popped elements of the first chunk are still alive
+            size_type first = _begin_local / CHUNK_SIZE * CHUNK_SIZE;
+            if (_end_local > first) {
+                for (size_type i = first; i < _end_local; i++)
+                    std::destroy_at(std::addressof(_map_local->element(i)));
+                for (size_type c = first / CHUNK_SIZE; c <= (_end_local - 1) / CHUNK_SIZE; c++)
+                    _alloc_t.deallocate(_map_local->chunk(c), CHUNK_SIZE);
+            }
+            _delete_map(_map_local);
+        }
+
+        /// READERS
+
+        /// @brief Takes a snapshot of the published elements. Any thread.
+        Snapshot snapshot() const {
+            std::atomic<std::uint64_t>* slot = _enter();
+            // end first: a map loaded later covers it, and a begin loaded
+            // later is at or past the map's first chunk
+            size_type end   = _end.load(std::memory_order_seq_cst);
+            const Map* map  = _map.load(std::memory_order_seq_cst);
+            size_type begin = std::min(_begin.load(std::memory_order_seq_cst), end);
+            return Snapshot(slot, map, begin, end);
+        }
+
+        /// WRITER
+
+        /// @brief Appends a new element constructed from args. Writer only.
+        template <class... Args>
+        void emplace_back(Args&&... args) {
+            size_type end = _end_local;
+            if (end % CHUNK_SIZE == 0) {
+                if (end / CHUNK_SIZE - _map_local->first >= _map_local->capacity) _remap();
+                _map_local->chunk(end / CHUNK_SIZE) = _alloc_t.allocate(CHUNK_SIZE);
+            }
+            try {
+                ::new (static_cast<void*>(std::addressof(_map_local->element(end))))
+                        T(std::forward<Args>(args)...);
+            } catch (...) {
+                if (end % CHUNK_SIZE == 0)
+                    _alloc_t.deallocate(_map_local->chunk(end / CHUNK_SIZE), CHUNK_SIZE);
+                throw;
+            }
+            _end_local = end + 1;
+            _end.store(end + 1, std::memory_order_release);
+        }
+
+        void push_back(const T& value) { emplace_back(value); }
+
+        void push_back(T&& value) { emplace_back(std::move(value)); }
+
+        /// @brief Removes the first element from the published range. The
+        /// element itself is destroyed when its whole chunk is reclaimed.
+        /// Writer only.
+        void pop_front() {
+            if (_begin_local == _end_local) return;
+            size_type begin = ++_begin_local;
+            _begin.store(begin, std::memory_order_seq_cst);
+            if (begin % CHUNK_SIZE == 0) _retire_chunk(_map_local->chunk(begin / CHUNK_SIZE - 1));
+        }
+
+        const T& front() const { return _map_local->element(_begin_local); }
+
+        const T& back() const { return _map_local->element(_end_local - 1); }
+
+        /// @brief Returns the number of elements. Exact on the writer thread,
+        /// a snapshot elsewhere.
+        size_type size() const noexcept {
+            size_type end = _end.load(std::memory_order_acquire);
+            return end - std::min(_begin.load(std::memory_order_acquire), end);
+        }
+
+        bool empty() const noexcept { return size() == 0; }
+
+        /// @brief Frees the retired chunks and maps no snapshot can reach any
+        /// more. Happens on its own every few retirements. Writer only.
+        void reclaim() { _reclaim(false); }
+
+    private:
+        struct Map {
+            size_type first;     // number of the chunk in chunks[0]
+            size_type capacity;
+            pointer* chunks;
+
+            pointer& chunk(size_type number) noexcept { return chunks[number - first]; }
+
+            pointer chunk(size_type number) const noexcept { return chunks[number - first]; }
+
+            T& element(size_type index) noexcept {
+                return chunk(index / CHUNK_SIZE)[index % CHUNK_SIZE];
+            }
+
+            const T& element(size_type index) const noexcept {
+                return chunk(index / CHUNK_SIZE)[index % CHUNK_SIZE];
+            }
+        };
+
+        struct alignas(CACHE_LINE_SIZE) Slot {
+            std::atomic<std::uint64_t> epoch{0};  // 0 when the slot is free
+        };
+
+        using allocator_pointer =
+                typename std::allocator_traits<Allocator>::template rebind_alloc<pointer>;
+
+        allocator_type _alloc_t;
+        allocator_pointer _alloc_p;
+
+        // published state
+        std::atomic<size_type> _begin{0}, _end{0};
+        std::atomic<Map*> _map;
+        std::atomic<std::uint64_t> _epoch{1};
+        mutable Slot _slots[READER_SLOTS];
+
+        // writer state
+        size_type _begin_local = 0, _end_local = 0;
+        Map* _map_local;
+        std::vector<std::pair<pointer, std::uint64_t>> _retired_chunks;
+        std::vector<std::pair<Map*, std::uint64_t>> _retired_maps;
+        size_type _reclaim_at = 16;  // retired count that triggers a reclaim
+
+        /// @brief Claims a free reader slot and announces the current epoch
+        /// in it, both with one CAS. The announcement comes before any load
+        /// of the published state, so the writer, which retires after
+        /// unpublishing, either sees it or was done unpublishing before it.
+        std::atomic<std::uint64_t>* _enter() const {
+            size_type start = std::hash<std::thread::id>()(std::this_thread::get_id());
+            while (true) {
+                for (size_type i = 0; i < READER_SLOTS; i++) {
+                    Slot& slot         = _slots[(start + i) % READER_SLOTS];
+                    std::uint64_t free = 0;
+                    if (slot.epoch.load(std::memory_order_relaxed) == 0 &&
+                        slot.epoch.compare_exchange_strong(free,
+                                                           _epoch.load(std::memory_order_seq_cst),
+                                                           std::memory_order_seq_cst))
+                        return &slot.epoch;
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        Map* _new_map(size_type first, size_type capacity) {
+            Map* map = new Map{first, capacity, nullptr};
+            try {
+                map->chunks = _alloc_p.allocate(capacity);
+            } catch (...) {
+                delete map;
+                throw;
+            }
+            return map;
+        }
+
+        void _delete_map(Map* map) noexcept {
+            _alloc_p.deallocate(map->chunks, map->capacity);
+            delete map;
+        }
+
+        /// @brief Publishes a new map starting at the chunk of begin, with
+        /// room for twice the chunks in use, and retires the old one.
+        void _remap() {
+            size_type first = _begin_local / CHUNK_SIZE;
+            size_type last  = _end_local / CHUNK_SIZE;  // the chunk about to be added
+            Map* map        = _new_map(first, std::max<size_type>(8, 2 * (last - first + 1)));
+            std::copy(_map_local->chunks + (first - _map_local->first),
+                      _map_local->chunks + (last - _map_local->first), map->chunks);
+            Map* old   = _map_local;
+            _map_local = map;
+            _map.store(map, std::memory_order_seq_cst);
+            _retired_maps.emplace_back(old, _epoch.fetch_add(1, std::memory_order_seq_cst));
+            _maybe_reclaim();
+        }
+
+        void _retire_chunk(pointer chunk) {
+            _retired_chunks.emplace_back(chunk, _epoch.fetch_add(1, std::memory_order_seq_cst));
+            _maybe_reclaim();
+        }
+
+        void _maybe_reclaim() {
+            if (_retired_chunks.size() + _retired_maps.size() >= _reclaim_at) _reclaim(false);
+        }
+
+        /// @brief Frees what was retired in an epoch older than every
+        /// announced one, or everything if all is set.
+        void _reclaim(bool all) {
+            std::uint64_t oldest = UINT64_MAX;
+            if (!all)
+                for (Slot& slot : _slots) {
+                    std::uint64_t epoch = slot.epoch.load(std::memory_order_seq_cst);
+                    if (epoch != 0) oldest = std::min(oldest, epoch);
+                }
+            auto chunk_end = std::partition(_retired_chunks.begin(), _retired_chunks.end(),
+                                            [&](const auto& r) { return r.second >= oldest; });
+            for (auto it = chunk_end; it != _retired_chunks.end(); ++it) {
+                std::destroy(it->first, it->first + CHUNK_SIZE);
+                _alloc_t.deallocate(it->first, CHUNK_SIZE);
+            }
+            _retired_chunks.erase(chunk_end, _retired_chunks.end());
+            auto map_end = std::partition(_retired_maps.begin(), _retired_maps.end(),
+                                          [&](const auto& r) { return r.second >= oldest; });
+            for (auto it = map_end; it != _retired_maps.end(); ++it) _delete_map(it->first);
+            _retired_maps.erase(map_end, _retired_maps.end());
+            // what a long-lived snapshot holds back is not scanned again and again
+            _reclaim_at = 2 * (_retired_chunks.size() + _retired_maps.size()) + 16;
+        }
+    };
+}  // namespace lab
@@ -0,0 +1,380 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "deque.h"
+#include "deque_algorithm.h"
+#include "deque_simd.h"
+
+namespace lab {
+    /// @brief Fixed set of std::thread workers running fork-join jobs.
+    /// run() hands out task indices through an atomic counter, the calling
+    /// thread takes tasks as well, and it returns once all of them are done.
+    /// Tasks must not call run() on the same pool.
+    class ThreadPool {
+    public:
+        /// @brief Starts threads - 1 workers (the caller of run() is the last
+        /// one).
+        /// @param threads total number of threads taking part in a job
+        explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency()) {
+            for (unsigned i = 1; i < std::max(threads, 1u); i++)
+                _workers.emplace_back([this] { _work(); });
+        }
+
+        ThreadPool(const ThreadPool&)            = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _wake.notify_all();
+            for (auto& worker : _workers) worker.join();
+        }
+
+        /// @brief Returns the number of threads taking part in a job.
+        unsigned size() const noexcept { return unsigned(_workers.size()) + 1; }
+
+        /// @brief Calls fn(0), ..., fn(tasks - 1) on the pool and returns when
+        /// all the calls have finished. The first exception thrown by a task
+        /// is rethrown here.
+        /// @param tasks number of tasks
+        /// @param fn callable taking the task index
+        template <class Fn>
+        void run(std::size_t tasks, Fn fn) {
+            if (tasks == 0) return;
+            std::lock_guard<std::mutex> run_lock(_run_mutex);
+            std::function<void(std::size_t)> job = std::ref(fn);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _job      = &job;
+                _tasks    = tasks;
+                _next     = 0;
+                _finished = 0;
+                _error    = nullptr;
+                _generation++;
+            }
+            _wake.notify_all();
+            _claim(job);
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            _done.wait(lock, [this] { return _finished == _tasks && _active == 0; });
+            _job = nullptr;
+            if (_error) std::rethrow_exception(_error);
+        }
+
+        /// @brief Returns the pool shared by the parallel algorithms, with one
+        /// thread per hardware thread.
+        static ThreadPool& instance() {
+            static ThreadPool pool;
+            return pool;
+        }
+
+    private:
+        std::vector<std::thread> _workers;
+        std::mutex _run_mutex, _mutex;
+        std::condition_variable _wake, _done;
+        const std::function<void(std::size_t)>* _job = nullptr;
+        std::size_t _tasks = 0, _finished = 0, _active = 0, _generation = 0;
+        std::atomic<std::size_t> _next{0};
+        std::exception_ptr _error;
+        bool _stop = false;
+
+        void _claim(const std::function<void(std::size_t)>& job) {
+            std::size_t done = 0;
+            for (std::size_t task; (task = _next++) < _tasks; done++) {
+                try {
+                    job(task);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (!_error) _error = std::current_exception();
+                }
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            _finished += done;
+            if (_finished == _tasks) _done.notify_all();
+        }
+
+        void _work() {
+            std::size_t seen = 0;
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true) {
+                _wake.wait(lock, [&] { return _stop || (_job && _generation != seen); });
+                if (_stop) return;
+                seen = _generation;
+                auto job = _job;
+                _active++;
+                lock.unlock();
+                _claim(*job);
+                lock.lock();
+                _active--;
+                if (_active == 0) _done.notify_all();
+            }
+        }
+    };
+
+    /// @brief Execution policy of the parallel algorithms below.
+    /// par runs on every thread of ThreadPool::instance(), par(n) splits the
+    /// work into n parts.
+    struct parallel_policy {
+        unsigned threads = 0;
+
+        constexpr parallel_policy operator()(unsigned n) const { return {n}; }
+
+        unsigned parts() const {
+            return threads ? threads : ThreadPool::instance().size();
+        }
+    };
+    inline constexpr parallel_policy par{};
+
+/// @brief Returns the start of part number part when [first, last) is cut
+/// into parts pieces along chunk boundaries. Only map cells are looked at, so
+/// the cost does not depend on the number of elements.
+    template <class Iter>
+    Iter chunk_partition_point(Iter first, Iter last, std::size_t part,
+                               std::size_t parts) {
+        if (part == 0) return first;
+        if (part >= parts) return last;
+        std::size_t chunks = last._chunk_ptr - first._chunk_ptr;
+        auto chunk         = first._chunk_ptr + chunks * part / parts;
+        if (chunk == first._chunk_ptr) return first;
+        return Iter(chunk, *chunk);
+    }
+
+/// @brief Calls fn(part, part_first, part_last) for chunk-aligned pieces of
+/// [first, last) on the shared thread pool.
+    template <class Iter, class Fn>
+    void _run_partitioned(const parallel_policy& policy, Iter first, Iter last,
+                          Fn fn) {
+        std::size_t chunks = last._chunk_ptr - first._chunk_ptr + 1;
+        std::size_t parts  = std::min<std::size_t>(policy.parts(), chunks);
+        ThreadPool::instance().run(parts, [&](std::size_t part) {
+            fn(part, chunk_partition_point(first, last, part, parts),
+               chunk_partition_point(first, last, part + 1, parts));
+        });
+    }
+
+/// @brief Applies f to every element of d in parallel.
+/// @param policy parallel execution policy
+/// @param d deque whose elements to visit
+/// @param f function taking an element reference
+    template <class T, class Alloc, class Fn>
+    void for_each(const parallel_policy& policy, Deque<T, Alloc>& d, Fn f) {
+        _run_partitioned(policy, d.begin(), d.end(),
+                         [&](std::size_t, auto first, auto last) {
+            for_each_segment(first, last, [&](T* from, T* to) {
+                for (; from != to; from++) f(*from);
+            });
+        });
+    }
+
+/// @brief Stores op(x) for every element x of src into dst, in parallel.
+/// dst is resized to the size of src first.
+/// @param policy parallel execution policy
+/// @param src source deque
+/// @param dst destination deque
+/// @param op unary operation
+    template <class T, class AllocT, class U, class AllocU, class UnaryOp>
+    void transform(const parallel_policy& policy, const Deque<T, AllocT>& src,
+                   Deque<U, AllocU>& dst, UnaryOp op) {
+        dst.resize(src.size());
+        _run_partitioned(policy, src.begin(), src.end(),
+                         [&](std::size_t, auto first, auto last) {
+            auto out = dst.begin() + (first - src.begin());
+            for_each_segment(first, last, [&](const T* from, const T* to) {
+                for (; from != to; from++, out++) *out = op(*from);
+            });
+        });
+    }
+
+/// @brief Folds the elements of d into init with op in parallel. Every part
+/// is reduced on its own and the partial results are then combined, so op
+/// must be associative and commutative; floating point results may differ
+/// from a left fold in the last bits.
+/// @param policy parallel execution policy
+/// @param d deque to reduce
+/// @param init initial value
+/// @param op binary operation
+/// @return The reduced value.
+    template <class T, class Alloc, class BinaryOp>
+    T reduce(const parallel_policy& policy, const Deque<T, Alloc>& d,
+             std::type_identity_t<T> init, BinaryOp op) {
+        std::vector<std::optional<T>> partial(policy.parts());
+        _run_partitioned(policy, d.begin(), d.end(),
+                         [&](std::size_t part, auto first, auto last) {
+            if (first == last) return;
+            T acc = *first++;
+            for_each_segment(first, last, [&](const T* from, const T* to) {
+                acc = simd::reduce<true>(from, to, std::move(acc), op);
+            });
+            partial[part] = std::move(acc);
+        });
+        for (auto& part : partial)
+            if (part) init = op(std::move(init), std::move(*part));
+        return init;
+    }
+
+/// @brief Counts the elements of d for which pred returns true, in parallel.
+/// @param policy parallel execution policy
+/// @param d deque to search
+/// @param pred unary predicate
+/// @return Number of matching elements.
+    template <class T, class Alloc, class Pred>
+    typename Deque<T, Alloc>::size_type count_if(const parallel_policy& policy,
+                                                 const Deque<T, Alloc>& d,
+                                                 Pred pred) {
+        std::atomic<std::size_t> total{0};
+        _run_partitioned(policy, d.begin(), d.end(),
+                         [&](std::size_t, auto first, auto last) {
+            std::size_t n = 0;
+            for_each_segment(first, last, [&](const T* from, const T* to) {
+                for (; from != to; from++) n += bool(pred(*from));
+            });
+            total += n;
+        });
+        return total;
+    }
+
+/// @brief Returns how many of the first diag elements of the merge of sorted
+/// a[0, m) and b[0, l) come from a (the merge path split point). Ties are
+/// taken from a first, as std::merge does.
+    template <class Ptr, class Compare>
+    std::size_t _merge_path(Ptr a, std::size_t m, Ptr b, std::size_t l,
+                            std::size_t diag, Compare& comp) {
+        std::size_t lo = diag > l ? diag - l : 0, hi = std::min(diag, m);
+        while (lo < hi) {
+            std::size_t mid = (lo + hi) / 2;
+            if (!comp(b[diag - mid - 1], a[mid]))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+/// @brief Move-constructs the merge of [a, a_last) and [b, b_last) at out and
+/// advances out past every element built, so a throw leaves [start, out)
+/// alive. Ties are taken from a first, as std::merge does.
+    template <class T, class Compare>
+    void _merge_construct(T* a, T* a_last, T* b, T* b_last, T*& out, Compare& comp) {
+        while (a != a_last && b != b_last) {
+            T& next = comp(*b, *a) ? *b++ : *a++;
+            std::construct_at(out, std::move(next));
+            out++;
+        }
+        out = std::uninitialized_move(a, a_last, out);
+        out = std::uninitialized_move(b, b_last, out);
+    }
+
+/// @brief Runs fn(task, out) on the shared pool for every start. fn constructs
+/// elements from starts[task] on and keeps out past the last one. If a task
+/// throws, the elements built by every task are destroyed before the
+/// exception is rethrown.
+    template <class T, class Fn>
+    void _construct_parts(const std::vector<T*>& starts, Fn fn) {
+        std::vector<T*> ends = starts;
+        try {
+            ThreadPool::instance().run(starts.size(),
+                                       [&](std::size_t task) { fn(task, ends[task]); });
+        } catch (...) {
+            for (std::size_t task = 0; task < starts.size(); task++)
+                std::destroy(starts[task], ends[task]);
+            throw;
+        }
+    }
+
+/// @brief Sorts the elements of d in parallel. Every chunk-aligned part is
+/// move-constructed into its slice of an uninitialized scratch buffer and
+/// sorted there with std::sort. The sorted slices are then merged pairwise
+/// between two buffers; every merge is cut into pieces along the merge path
+/// so all threads take part in it. The result is moved back chunk by chunk.
+/// With one part this is the serial sort. T must be move constructible and
+/// move assignable.
+/// @param policy parallel execution policy
+/// @param d deque to sort
+/// @param comp comparison function object
+    template <class T, class Alloc, class Compare = std::less<>>
+    void sort(const parallel_policy& policy, Deque<T, Alloc>& d,
+              Compare comp = Compare()) {
+        std::size_t n = d.size();
+        if (n < 2) return;
+        auto first = d.begin(), last = d.end();
+        std::size_t chunks = last._chunk_ptr - first._chunk_ptr + 1;
+        std::size_t parts  = std::min<std::size_t>(policy.parts(), chunks);
+        auto& pool         = ThreadPool::instance();
+
+        std::vector<std::size_t> part_bounds(parts + 1);
+        for (std::size_t part = 0; part <= parts; part++)
+            part_bounds[part] = chunk_partition_point(first, last, part, parts) - first;
+
+        _SortBuffer<T, Alloc> src(d.get_allocator(), n), dst(d.get_allocator(), parts > 1 ? n : 0);
+        std::vector<T*> part_starts(parts);
+        for (std::size_t part = 0; part < parts; part++)
+            part_starts[part] = src.begin() + part_bounds[part];
+        _construct_parts(part_starts, [&](std::size_t part, T*& out) {
+            for_each_segment(chunk_partition_point(first, last, part, parts),
+                             chunk_partition_point(first, last, part + 1, parts),
+                             [&](T* from, T* to) { out = std::uninitialized_move(from, to, out); });
+            std::sort(part_starts[part], out, comp);
+        });
+        src.set_size(n);
+
+        // a piece merges the outputs [from, to) of runs [left, mid) and
+        // [mid, right) of src into dst
+        struct Piece {
+            std::size_t left, mid, right, from, to;
+        };
+        std::vector<std::size_t> bounds = part_bounds;
+        while (bounds.size() > 2) {
+            std::vector<Piece> pieces;
+            std::vector<std::size_t> next_bounds{0};
+            for (std::size_t run = 0; run + 1 < bounds.size(); run += 2) {
+                std::size_t left = bounds[run], mid = bounds[run + 1];
+                std::size_t right = run + 2 < bounds.size() ? bounds[run + 2] : mid;
+                std::size_t len   = right - left;
+                std::size_t count = std::max<std::size_t>(1, len * parts / n);
+                for (std::size_t k = 0; k < count; k++)
+                    pieces.push_back({left, mid, right, len * k / count,
+                                      len * (k + 1) / count});
+                next_bounds.push_back(right);
+            }
+            std::vector<T*> piece_starts;
+            for (const Piece& piece : pieces)
+                piece_starts.push_back(dst.begin() + piece.left + piece.from);
+            _construct_parts(piece_starts, [&](std::size_t i, T*& out) {
+                const Piece& piece = pieces[i];
+                T* a = src.begin() + piece.left;
+                T* b = src.begin() + piece.mid;
+                std::size_t m = piece.mid - piece.left, l = piece.right - piece.mid;
+                std::size_t a_from = _merge_path(a, m, b, l, piece.from, comp);
+                std::size_t a_to   = _merge_path(a, m, b, l, piece.to, comp);
+                _merge_construct(a + a_from, a + a_to, b + (piece.from - a_from),
+                                 b + (piece.to - a_to), out, comp);
+            });
+            dst.set_size(n);
+            src.clear();
+            src.swap(dst);
+            bounds.swap(next_bounds);
+        }
+
+        pool.run(parts, [&](std::size_t part) {
+            T* in = src.begin() + part_bounds[part];
+            for_each_segment(chunk_partition_point(first, last, part, parts),
+                             chunk_partition_point(first, last, part + 1, parts),
+                             [&](T* from, T* to) {
+                                 std::move(in, in + (to - from), from);
+                                 in += to - from;
+                             });
+        });
+    }
+}  // namespace lab
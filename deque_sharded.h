@@ -0,0 +1,150 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "deque.h"
+
+namespace lab {
+    namespace detail {
+        /// @brief Round-robin index of the calling thread, handed out the
+        /// first time it asks and shared by every ShardedDeque specialization.
+        inline unsigned shard_thread_index() {
+            static std::atomic<unsigned> next{0};
+            thread_local unsigned index = next.fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+    }  // namespace detail
+
+    /// @brief Append-mostly deque split into shards, one per hardware thread
+    /// by default, each a Deque behind its own mutex on its own cache
+    /// lines. A thread always appends to the same shard, picked round-robin
+    /// the first time it touches any ShardedDeque, so as long as there are
+    /// no more appending threads than shards, every lock is uncontended and
+    /// no cache line is written by two threads.
+    ///
+    /// The consumer takes everything with drain_all(), which swaps every
+    /// shard with an empty Deque under its lock. With Ordered set, each
+    /// element is stamped with a global sequence number when it is pushed
+    /// and drain_all() merges the shards back into push order; the stamp is
+    /// one shared atomic increment per push, which costs part of what the
+    /// sharding saves.
+    template <typename T, bool Ordered = false, typename Allocator = Allocator<T>>
+    class ShardedDeque {
+        struct Stamped {
+            std::uint64_t sequence;
+            T value;
+        };
+
+        using entry_type = std::conditional_t<Ordered, Stamped, T>;
+        using entry_allocator =
+                typename std::allocator_traits<Allocator>::template rebind_alloc<entry_type>;
+
+    public:
+        using value_type     = T;
+        using allocator_type = Allocator;
+        using size_type      = std::size_t;
+
+        /// @param shards number of shards, at least 1
+        explicit ShardedDeque(unsigned shards = std::thread::hardware_concurrency())
+                : _shard_count(std::max(shards, 1u)), _shards(new Shard[_shard_count]) {}
+
+        ShardedDeque(const ShardedDeque&)            = delete;
+        ShardedDeque& operator=(const ShardedDeque&) = delete;
+
+        /// @brief Appends value to the shard of the calling thread.
+        void push_back(const T& value) { emplace_back(value); }
+
+        void push_back(T&& value) { emplace_back(std::move(value)); }
+
+        /// @brief Appends an element constructed from args to the shard of
+        /// the calling thread.
+        template <class... Args>
+        void emplace_back(Args&&... args) {
+            Shard& shard = _shards[detail::shard_thread_index() % _shard_count];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if constexpr (Ordered)
+                shard.items.push_back(Stamped{_sequence.fetch_add(1, std::memory_order_relaxed),
+                                              T(std::forward<Args>(args)...)});
+            else
+                shard.items.emplace_back(std::forward<Args>(args)...);
+        }
+
+        /// @brief Moves every element out to out and empties the shards. Each
+        /// shard is locked only to swap its Deque with an empty one. Without
+        /// Ordered the shards come out one after the other, each in the
+        /// order its threads pushed; with Ordered the elements come out in
+        /// global push order.
+        /// @return Output iterator past the last element written.
+        template <class OutputIt>
+        OutputIt drain_all(OutputIt out) {
+            std::vector<Deque<entry_type, entry_allocator>> taken(_shard_count);
+            for (unsigned i = 0; i < _shard_count; i++) {
+                std::lock_guard<std::mutex> lock(_shards[i].mutex);
+                taken[i].swap(_shards[i].items);
+            }
+            if constexpr (Ordered) {
+                return _merge(taken, out);
+            } else {
+                for (auto& items : taken)
+                    out = items.pop_front_n(items.size(), out);
+                return out;
+            }
+        }
+
+        /// @brief Returns a snapshot of the number of elements.
+        size_type size() const {
+            size_type total = 0;
+            for (unsigned i = 0; i < _shard_count; i++) {
+                std::lock_guard<std::mutex> lock(_shards[i].mutex);
+                total += _shards[i].items.size();
+            }
+            return total;
+        }
+
+        bool empty() const { return size() == 0; }
+
+        unsigned shard_count() const noexcept { return _shard_count; }
+
+    private:
+        struct alignas(CACHE_LINE_SIZE) Shard {
+            mutable std::mutex mutex;
+            Deque<entry_type, entry_allocator> items;
+        };
+
+        unsigned _shard_count;
+        std::unique_ptr<Shard[]> _shards;
+        alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> _sequence{0};
+
+        /// @brief Merges shards, each sorted by sequence, by repeatedly taking
+        /// the smallest front; a heap of shard indices keeps that O(log
+        /// shards) per element.
+        template <class OutputIt>
+        static OutputIt _merge(std::vector<Deque<entry_type, entry_allocator>>& shards,
+                               OutputIt out) {
+            auto later = [&](unsigned a, unsigned b) {
+                return shards[a].front().sequence > shards[b].front().sequence;
+            };
+            std::vector<unsigned> heap;
+            for (unsigned i = 0; i < shards.size(); i++)
+                if (!shards[i].empty()) heap.push_back(i);
+            std::make_heap(heap.begin(), heap.end(), later);
+            while (!heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                auto& shard = shards[heap.back()];
+                *out++      = std::move(shard.front().value);
+                shard.pop_front();
+                if (shard.empty()) heap.pop_back();
+                else std::push_heap(heap.begin(), heap.end(), later);
+            }
+            return out;
+        }
+    };
+}  // namespace lab
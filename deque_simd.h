@@ -0,0 +1,342 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LAB_DEQUE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/// Kernels over one contiguous span of a deque chunk. Integral element types
+/// of 1, 2, 4 and 8 bytes, float and double use AVX2 or SSE2 on x86, chosen
+/// at runtime; other types and other targets fall back to scalar loops.
+/// Floating point lanes compare ordered, so NaN equals nothing and -0.0
+/// equals 0.0, exactly as operator== does. remove_copy packs the kept lanes
+/// of 4- and 8-byte types with a shuffle table under AVX2 or SSSE3.
+namespace lab::simd {
+    template <class T>
+    constexpr bool is_vectorizable_v =
+            (std::is_integral_v<T> &&
+             (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)) ||
+            std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+    template <class T>
+    constexpr bool is_compressible_v =
+            (std::is_integral_v<T> && (sizeof(T) == 4 || sizeof(T) == 8)) ||
+            std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+    template <class T>
+    const T* find_scalar(const T* first, const T* last, const T& value) {
+        for (; first != last; first++)
+            if (*first == value) return first;
+        return last;
+    }
+
+    template <class T>
+    std::size_t count_scalar(const T* first, const T* last, const T& value) {
+        std::size_t n = 0;
+        for (; first != last; first++) n += *first == value;
+        return n;
+    }
+
+    /// Every element is copied and out only advances past the kept ones, so
+    /// the loop has no branch on the comparison.
+    template <class T, class U>
+    T* remove_copy_scalar(const T* first, const T* last, T* out, const U& value) {
+        for (; first != last; first++) {
+            *out = *first;
+            out += !(*first == value);
+        }
+        return out;
+    }
+
+    /// @brief Builds the shuffle table of remove_copy: row mask lists, in
+    /// order, the Index units of every lane whose bit is set in mask, and
+    /// leaves the rest of the row pointing at unit 0.
+    template <class Index, std::size_t Lanes, std::size_t Units>
+    constexpr std::array<std::array<Index, Units>, (1u << Lanes)> make_compress_table() {
+        std::array<std::array<Index, Units>, (1u << Lanes)> table{};
+        constexpr std::size_t per_lane = Units / Lanes;
+        for (std::size_t mask = 0; mask < table.size(); mask++) {
+            std::size_t out = 0;
+            for (std::size_t lane = 0; lane < Lanes; lane++)
+                if (mask >> lane & 1)
+                    for (std::size_t k = 0; k < per_lane; k++)
+                        table[mask][out++] = Index(lane * per_lane + k);
+        }
+        return table;
+    }
+
+    template <class Index, std::size_t Lanes, std::size_t Units>
+    inline constexpr auto compress_table = make_compress_table<Index, Lanes, Units>();
+
+#ifdef LAB_DEQUE_X86_SIMD
+    inline bool has_avx2() {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+
+    inline bool has_ssse3() {
+        static const bool supported = __builtin_cpu_supports("ssse3");
+        return supported;
+    }
+
+    template <class T>
+    __attribute__((target("avx2"))) __m256i broadcast_avx2(T value) {
+        if constexpr (std::is_same_v<T, float>) return _mm256_castps_si256(_mm256_set1_ps(value));
+        else if constexpr (std::is_same_v<T, double>) return _mm256_castpd_si256(_mm256_set1_pd(value));
+        else if constexpr (sizeof(T) == 1) return _mm256_set1_epi8(char(value));
+        else if constexpr (sizeof(T) == 2) return _mm256_set1_epi16(short(value));
+        else if constexpr (sizeof(T) == 4) return _mm256_set1_epi32(int(value));
+        else return _mm256_set1_epi64x((long long)(value));
+    }
+
+    /// @return All-ones in every lane of block equal to needle. Floating
+    /// point lanes use an ordered compare, so NaN matches nothing and -0.0
+    /// matches 0.0, as with operator==.
+    template <class T>
+    __attribute__((target("avx2"))) __m256i equal_avx2(__m256i block, __m256i needle) {
+        if constexpr (std::is_same_v<T, float>)
+            return _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(block),
+                                                     _mm256_castsi256_ps(needle), _CMP_EQ_OQ));
+        else if constexpr (std::is_same_v<T, double>)
+            return _mm256_castpd_si256(_mm256_cmp_pd(_mm256_castsi256_pd(block),
+                                                     _mm256_castsi256_pd(needle), _CMP_EQ_OQ));
+        else if constexpr (sizeof(T) == 1) return _mm256_cmpeq_epi8(block, needle);
+        else if constexpr (sizeof(T) == 2) return _mm256_cmpeq_epi16(block, needle);
+        else if constexpr (sizeof(T) == 4) return _mm256_cmpeq_epi32(block, needle);
+        else return _mm256_cmpeq_epi64(block, needle);
+    }
+
+    /// @return movemask of the lanes of 32 bytes at p equal to needle; every
+    /// element sets sizeof(T) bits.
+    template <class T>
+    __attribute__((target("avx2"))) unsigned match_avx2(const T* p, __m256i needle) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        return unsigned(_mm256_movemask_epi8(equal_avx2<T>(block, needle)));
+    }
+
+    template <class T>
+    __attribute__((target("avx2"))) const T* find_avx2(const T* first,
+                                                       const T* last,
+                                                       const T& value) {
+        constexpr std::ptrdiff_t lanes = 32 / sizeof(T);
+        __m256i needle = broadcast_avx2(value);
+        for (; last - first >= lanes; first += lanes)
+            if (unsigned mask = match_avx2(first, needle))
+                return first + __builtin_ctz(mask) / sizeof(T);
+        return find_scalar(first, last, value);
+    }
+
+    template <class T>
+    __attribute__((target("avx2"))) std::size_t count_avx2(const T* first,
+                                                           const T* last,
+                                                           const T& value) {
+        constexpr std::ptrdiff_t lanes = 32 / sizeof(T);
+        __m256i needle = broadcast_avx2(value);
+        std::size_t bits = 0;
+        for (; last - first >= lanes; first += lanes)
+            bits += __builtin_popcount(match_avx2(first, needle));
+        return bits / sizeof(T) + count_scalar(first, last, value);
+    }
+
+    /// Writes the kept lanes of each 32-byte block to out with one
+    /// permutevar8x32 from compress_table. The store is a full vector, so it
+    /// needs lanes of room at out; the caller's [out, out + (last - first))
+    /// guarantees that while a whole block is left.
+    template <class T>
+    __attribute__((target("avx2"))) T* remove_copy_avx2(const T* first, const T* last,
+                                                       T* out, const T& value) {
+        constexpr std::size_t lanes = 32 / sizeof(T);
+        __m256i needle = broadcast_avx2(value);
+        for (; last - first >= std::ptrdiff_t(lanes); first += lanes) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+            __m256i eq    = equal_avx2<T>(block, needle);
+            unsigned keep;
+            if constexpr (sizeof(T) == 4)
+                keep = ~unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(eq))) & 0xFF;
+            else
+                keep = ~unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(eq))) & 0xF;
+            __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+                    compress_table<std::uint32_t, lanes, 8>[keep].data()));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                                _mm256_permutevar8x32_epi32(block, index));
+            out += __builtin_popcount(keep);
+        }
+        return remove_copy_scalar(first, last, out, value);
+    }
+
+    template <class T>
+    __m128i broadcast_sse2(T value) {
+        if constexpr (std::is_same_v<T, float>) return _mm_castps_si128(_mm_set1_ps(value));
+        else if constexpr (std::is_same_v<T, double>) return _mm_castpd_si128(_mm_set1_pd(value));
+        else if constexpr (sizeof(T) == 1) return _mm_set1_epi8(char(value));
+        else if constexpr (sizeof(T) == 2) return _mm_set1_epi16(short(value));
+        else return _mm_set1_epi32(int(value));
+    }
+
+    template <class T>
+    __m128i equal_sse2(__m128i block, __m128i needle) {
+        if constexpr (std::is_same_v<T, float>)
+            return _mm_castps_si128(_mm_cmpeq_ps(_mm_castsi128_ps(block), _mm_castsi128_ps(needle)));
+        else if constexpr (std::is_same_v<T, double>)
+            return _mm_castpd_si128(_mm_cmpeq_pd(_mm_castsi128_pd(block), _mm_castsi128_pd(needle)));
+        else if constexpr (sizeof(T) == 1) return _mm_cmpeq_epi8(block, needle);
+        else if constexpr (sizeof(T) == 2) return _mm_cmpeq_epi16(block, needle);
+        else return _mm_cmpeq_epi32(block, needle);
+    }
+
+    template <class T>
+    unsigned match_sse2(const T* p, __m128i needle) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        return unsigned(_mm_movemask_epi8(equal_sse2<T>(block, needle)));
+    }
+
+    /// Same as remove_copy_avx2 with a pshufb byte table over 16-byte
+    /// blocks. 8-byte integers stay scalar, as in find_sse2.
+    template <class T>
+    __attribute__((target("ssse3"))) T* remove_copy_ssse3(const T* first, const T* last,
+                                                         T* out, const T& value) {
+        if constexpr (sizeof(T) == 8 && std::is_integral_v<T>) {
+            return remove_copy_scalar(first, last, out, value);
+        } else {
+            constexpr std::size_t lanes = 16 / sizeof(T);
+            __m128i needle = broadcast_sse2(value);
+            for (; last - first >= std::ptrdiff_t(lanes); first += lanes) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+                __m128i eq    = equal_sse2<T>(block, needle);
+                unsigned keep;
+                if constexpr (sizeof(T) == 4)
+                    keep = ~unsigned(_mm_movemask_ps(_mm_castsi128_ps(eq))) & 0xF;
+                else
+                    keep = ~unsigned(_mm_movemask_pd(_mm_castsi128_pd(eq))) & 0x3;
+                __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                        compress_table<std::uint8_t, lanes, 16>[keep].data()));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(block, index));
+                out += __builtin_popcount(keep);
+            }
+            return remove_copy_scalar(first, last, out, value);
+        }
+    }
+
+    // SSE2 has no 64-bit integer compare, so 8-byte integers stay scalar
+    // without AVX2; double has cmpeq_pd
+    template <class T>
+    const T* find_sse2(const T* first, const T* last, const T& value) {
+        if constexpr (sizeof(T) == 8 && std::is_integral_v<T>) {
+            return find_scalar(first, last, value);
+        } else {
+            constexpr std::ptrdiff_t lanes = 16 / sizeof(T);
+            __m128i needle = broadcast_sse2(value);
+            for (; last - first >= lanes; first += lanes)
+                if (unsigned mask = match_sse2(first, needle))
+                    return first + __builtin_ctz(mask) / sizeof(T);
+            return find_scalar(first, last, value);
+        }
+    }
+
+    template <class T>
+    std::size_t count_sse2(const T* first, const T* last, const T& value) {
+        if constexpr (sizeof(T) == 8 && std::is_integral_v<T>) {
+            return count_scalar(first, last, value);
+        } else {
+            constexpr std::ptrdiff_t lanes = 16 / sizeof(T);
+            __m128i needle = broadcast_sse2(value);
+            std::size_t bits = 0;
+            for (; last - first >= lanes; first += lanes)
+                bits += __builtin_popcount(match_sse2(first, needle));
+            return bits / sizeof(T) + count_scalar(first, last, value);
+        }
+    }
+#endif
+
+    /// @brief Returns a pointer to the first element of [first, last) equal
+    /// to value, or last.
+    template <class T>
+    const T* find(const T* first, const T* last, const T& value) {
+#ifdef LAB_DEQUE_X86_SIMD
+        if constexpr (is_vectorizable_v<T>)
+            return has_avx2() ? find_avx2(first, last, value)
+                              : find_sse2(first, last, value);
+#endif
+        return find_scalar(first, last, value);
+    }
+
+    /// @brief Returns the number of elements of [first, last) equal to value.
+    template <class T>
+    std::size_t count(const T* first, const T* last, const T& value) {
+#ifdef LAB_DEQUE_X86_SIMD
+        if constexpr (is_vectorizable_v<T>)
+            return has_avx2() ? count_avx2(first, last, value)
+                              : count_sse2(first, last, value);
+#endif
+        return count_scalar(first, last, value);
+    }
+
+    /// @brief Copies the elements of [first, last) that are not equal to
+    /// value to out, keeping their order. out may equal first or lie before
+    /// it, and [out, out + (last - first)) must be writable: the vector
+    /// kernels store whole blocks past the last kept element.
+    /// @return The end of the copied range.
+    template <class T>
+    T* remove_copy(const T* first, const T* last, T* out, const T& value) {
+#ifdef LAB_DEQUE_X86_SIMD
+        if constexpr (is_compressible_v<T>) {
+            if (has_avx2()) return remove_copy_avx2(first, last, out, value);
+            if (has_ssse3()) return remove_copy_ssse3(first, last, out, value);
+        }
+#endif
+        return remove_copy_scalar(first, last, out, value);
+    }
+
+    /// @brief Folds [first, last) into init with op. With Reassociate the
+    /// span is split across 8 independent accumulators that are combined
+    /// pairwise at the end, which lets the compiler keep a whole vector of
+    /// partial results in flight; without it the order is a strict left
+    /// fold.
+    template <bool Reassociate, class T, class BinaryOp>
+    T reduce(const T* first, const T* last, T init, BinaryOp op) {
+        constexpr std::ptrdiff_t lanes = 8;
+        if constexpr (Reassociate) {
+            if (last - first >= lanes) {
+                T acc[lanes];
+                for (std::ptrdiff_t k = 0; k < lanes; k++) acc[k] = first[k];
+                for (first += lanes; last - first >= lanes; first += lanes)
+                    for (std::ptrdiff_t k = 0; k < lanes; k++)
+                        acc[k] = op(acc[k], first[k]);
+                for (std::ptrdiff_t width = lanes / 2; width > 0; width /= 2)
+                    for (std::ptrdiff_t k = 0; k < width; k++)
+                        acc[k] = op(acc[k], acc[k + width]);
+                init = op(init, acc[0]);
+            }
+        }
+        for (; first != last; first++) init = op(init, *first);
+        return init;
+    }
+
+    /// @brief Updates lo and hi with the smallest and the largest elements of
+    /// [first, last), using 8 independent pairs of accumulators.
+    template <class T>
+    void minmax(const T* first, const T* last, T& lo, T& hi) {
+        constexpr std::ptrdiff_t lanes = 8;
+        if (last - first >= lanes) {
+            T acc_lo[lanes], acc_hi[lanes];
+            for (std::ptrdiff_t k = 0; k < lanes; k++) acc_lo[k] = acc_hi[k] = first[k];
+            for (first += lanes; last - first >= lanes; first += lanes)
+                for (std::ptrdiff_t k = 0; k < lanes; k++) {
+                    acc_lo[k] = first[k] < acc_lo[k] ? first[k] : acc_lo[k];
+                    acc_hi[k] = acc_hi[k] < first[k] ? first[k] : acc_hi[k];
+                }
+            for (std::ptrdiff_t k = 0; k < lanes; k++) {
+                lo = acc_lo[k] < lo ? acc_lo[k] : lo;
+                hi = hi < acc_hi[k] ? acc_hi[k] : hi;
+            }
+        }
+        for (; first != last; first++) {
+            lo = *first < lo ? *first : lo;
+            hi = hi < *first ? *first : hi;
+        }
+    }
+}  // namespace lab::simd
@@ -0,0 +1,228 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <utility>
+
+#include "deque.h"
+
+namespace lab {
+    /// @brief Unbounded lock-free queue between exactly one producer thread
+    /// and one consumer thread, stored like Deque in 512-byte chunks. The
+    /// chunks form a chain: the producer appends to the last one and
+    /// publishes every element with a release store of its counter, the
+    /// consumer reads the counter with an acquire load and follows the chain.
+    /// Drained chunks go back to the producer through a lock-free return
+    /// list, so a queue in steady state does not allocate.
+    template <typename T, typename Allocator = Allocator<T>>
+    class SpscDeque {
+    public:
+        using value_type     = T;
+        using allocator_type = Allocator;
+        using size_type      = std::size_t;
+
+        const static size_type CHUNK_SIZE =
+                512 / sizeof(T) == 0 ? 1 : 512 / sizeof(T);
+
+        explicit SpscDeque(const Allocator& alloc = Allocator())
+                : _alloc(alloc) {
+            _tail_chunk = _head_chunk = _new_chunk();
+        }
+
+        SpscDeque(const SpscDeque&)            = delete;
+        SpscDeque& operator=(const SpscDeque&) = delete;
+
+        /// @brief Destroys the elements left in the queue and frees all the
+        /// chunks. No thread may use the queue any more.
+        ~SpscDeque() {
+            for (size_type n = _pushed.load() - _popped_local; n > 0; n--) {
+                if (_head_index == CHUNK_SIZE) _next_head_chunk();
+                std::destroy_at(_head_chunk->slot(_head_index++));
+            }
+            _free_chain(_head_chunk);
+            _free_chain(_returned.exchange(nullptr));
+            _free_chain(_free_chunks);
+        }
+
+        /// PRODUCER
+
+        /// @brief Appends a new element constructed from args. Producer only.
+        template <class... Args>
+        void emplace_back(Args&&... args) {
+            if (_tail_index == CHUNK_SIZE) {
+                Chunk* chunk = _take_chunk();
+                _tail_chunk->next.store(chunk, std::memory_order_relaxed);
+                _tail_chunk = chunk;
+                _tail_index = 0;
+            }
+            ::new (static_cast<void*>(_tail_chunk->slot(_tail_index))) T(
+                    std::forward<Args>(args)...);
+            _tail_index++;
+            _pushed.store(++_pushed_local, std::memory_order_release);
+        }
+
+        /// @brief Appends a copy of value. Producer only.
+        void push_back(const T& value) { emplace_back(value); }
+
+        /// @brief Appends value by moving it. Producer only.
+        void push_back(T&& value) { emplace_back(std::move(value)); }
+
+        /// @brief Appends copies of the elements of values with a single
+        /// release store of the counter for the whole batch. If a copy throws,
+        /// the elements before it are published. Producer only.
+        void push_back_n(std::span<const T> values) {
+            try {
+                for (const T& value : values) {
+                    if (_tail_index == CHUNK_SIZE) {
+                        Chunk* chunk = _take_chunk();
+                        _tail_chunk->next.store(chunk, std::memory_order_relaxed);
+                        _tail_chunk = chunk;
+                        _tail_index = 0;
+                    }
+                    ::new (static_cast<void*>(_tail_chunk->slot(_tail_index))) T(value);
+                    _tail_index++;
+                    _pushed_local++;
+                }
+            } catch (...) {
+                _pushed.store(_pushed_local, std::memory_order_release);
+                throw;
+            }
+            _pushed.store(_pushed_local, std::memory_order_release);
+        }
+
+        /// CONSUMER
+
+        /// @brief Moves the first element into out and removes it, if there is
+        /// one. Consumer only.
+        /// @return false if the queue was empty.
+        bool try_pop_front(T& out) {
+            if (_popped_local == _pushed_cache) {
+                _pushed_cache = _pushed.load(std::memory_order_acquire);
+                if (_popped_local == _pushed_cache) return false;
+            }
+            if (_head_index == CHUNK_SIZE) _next_head_chunk();
+            T* el = _head_chunk->slot(_head_index++);
+            out   = std::move(*el);
+            std::destroy_at(el);
+            _popped.store(++_popped_local, std::memory_order_release);
+            return true;
+        }
+
+        /// @brief Moves up to n elements to out, in order, and removes them,
+        /// with one acquire load and one release store for the whole batch.
+        /// If a move throws, the elements before it stay popped. Consumer
+        /// only.
+        /// @return Output iterator past the last element written.
+        template <class OutputIt>
+        OutputIt pop_front_n(size_type n, OutputIt out) {
+            if (_pushed_cache - _popped_local < n)
+                _pushed_cache = _pushed.load(std::memory_order_acquire);
+            size_type last = _popped_local + std::min(n, _pushed_cache - _popped_local);
+            try {
+                for (; _popped_local != last; _popped_local++) {
+                    if (_head_index == CHUNK_SIZE) _next_head_chunk();
+                    T* el = _head_chunk->slot(_head_index);
+                    *out++ = std::move(*el);
+                    std::destroy_at(el);
+                    _head_index++;
+                }
+            } catch (...) {
+                _popped.store(_popped_local, std::memory_order_release);
+                throw;
+            }
+            _popped.store(_popped_local, std::memory_order_release);
+            return out;
+        }
+
+        /// @brief Checks whether there is nothing to pop. Exact on the
+        /// consumer thread, a snapshot elsewhere.
+        bool empty() const noexcept { return size() == 0; }
+
+        /// @brief Returns the number of published and not yet popped elements.
+        /// Exact on the consumer thread, a snapshot elsewhere.
+        size_type size() const noexcept {
+            size_type popped = _popped.load(std::memory_order_acquire);
+            return _pushed.load(std::memory_order_acquire) - popped;
+        }
+
+    private:
+        struct Chunk {
+            std::atomic<Chunk*> next{nullptr};
+            alignas(T) unsigned char storage[sizeof(T) * CHUNK_SIZE];
+
+            T* slot(size_type i) noexcept {
+                return std::launder(reinterpret_cast<T*>(storage)) + i;
+            }
+        };
+
+        using chunk_allocator =
+                typename std::allocator_traits<Allocator>::template rebind_alloc<Chunk>;
+        chunk_allocator _alloc;
+
+        // Each side's state, including the counter it publishes, has cache
+        // lines of its own, so a push never invalidates the line the consumer
+        // works on and a pop never the producer's. The consumer reads _pushed
+        // only when its cached copy runs out; the producer of an unbounded
+        // queue never needs _popped.
+
+        // producer side
+        alignas(CACHE_LINE_SIZE) Chunk* _tail_chunk;
+        size_type _tail_index    = 0;
+        size_type _pushed_local  = 0;
+        Chunk* _free_chunks      = nullptr;
+        std::atomic<size_type> _pushed{0};
+
+        // consumer side, with the return list it pushes to
+        alignas(CACHE_LINE_SIZE) Chunk* _head_chunk;
+        size_type _head_index    = 0;
+        size_type _popped_local  = 0;
+        size_type _pushed_cache  = 0;
+        std::atomic<size_type> _popped{0};
+        std::atomic<Chunk*> _returned{nullptr};
+
+        Chunk* _new_chunk() {
+            Chunk* chunk = _alloc.allocate(1);
+            return ::new (static_cast<void*>(chunk)) Chunk();
+        }
+
+        /// @brief Takes a chunk from the producer's free list, refilling it
+        /// from the return list in one exchange, or allocates a new one.
+        Chunk* _take_chunk() {
+            if (!_free_chunks)
+                _free_chunks = _returned.exchange(nullptr, std::memory_order_acquire);
+            if (!_free_chunks) return _new_chunk();
+            Chunk* chunk = _free_chunks;
+            _free_chunks = chunk->next.load(std::memory_order_relaxed);
+            chunk->next.store(nullptr, std::memory_order_relaxed);
+            return chunk;
+        }
+
+        /// @brief Steps the consumer to the next chunk and hands the drained
+        /// one back to the producer. Only the consumer pushes to the return
+        /// list and the producer only takes the whole list, so there is no
+        /// ABA problem.
+        void _next_head_chunk() {
+            Chunk* drained = _head_chunk;
+            _head_chunk    = drained->next.load(std::memory_order_relaxed);
+            _head_index    = 0;
+            Chunk* top     = _returned.load(std::memory_order_relaxed);
+            do {
+                drained->next.store(top, std::memory_order_relaxed);
+            } while (!_returned.compare_exchange_weak(top, drained,
+                                                      std::memory_order_release,
+                                                      std::memory_order_relaxed));
+        }
+
+        void _free_chain(Chunk* chunk) noexcept {
+            while (chunk) {
+                Chunk* next = chunk->next.load(std::memory_order_relaxed);
+                std::destroy_at(chunk);
+                _alloc.deallocate(chunk, 1);
+                chunk = next;
+            }
+        }
+    };
+}  // namespace lab
@@ -0,0 +1,323 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "deque_concurrent.h"
+#include "deque_simd.h"
+#include "deque_work_stealing.h"
+
+namespace lab {
+    /// @brief Work-stealing task scheduler. Every worker owns a
+    /// WorkStealingDeque: tasks submitted from a worker go to the back of its
+    /// own deque and it pops them LIFO, idle workers steal FIFO from the front
+    /// of a randomly chosen victim. Tasks submitted from other threads go
+    /// through a shared ConcurrentDeque. A worker that finds nothing spins
+    /// with exponential backoff, then yields, then sleeps until a new task is
+    /// submitted. Other threads waiting for tasks back off the same way and
+    /// then sleep until a pending count they may wait for reaches zero.
+    class TaskPool {
+    public:
+        /// @brief Group of tasks that can be waited for on its own, which is
+        /// how tasks wait for the tasks they spawn. On a worker, wait() runs
+        /// other tasks while the group is not finished, so it may be called
+        /// from tasks.
+        class TaskGroup {
+        public:
+            explicit TaskGroup(TaskPool& pool) : _pool(pool) {}
+
+            TaskGroup(const TaskGroup&)            = delete;
+            TaskGroup& operator=(const TaskGroup&) = delete;
+
+            ~TaskGroup() { _pool._help_until([this] { return _pending.load() == 0; }); }
+
+            /// @brief Submits fn as a task of this group.
+            template <class Fn>
+            void run(Fn&& fn) {
+                _pending.fetch_add(1, std::memory_order_relaxed);
+                _pool._submit(new Task{std::function<void()>(std::forward<Fn>(fn)), this});
+            }
+
+            /// @brief Returns once every task of the group has finished. The
+            /// first exception thrown by one of them is rethrown here.
+            void wait() {
+                _pool._help_until([this] {
+                    return _pending.load(std::memory_order_acquire) == 0;
+                });
+                if (_error) std::rethrow_exception(std::exchange(_error, nullptr));
+            }
+
+        private:
+            friend class TaskPool;
+
+            TaskPool& _pool;
+            std::atomic<std::size_t> _pending{0};
+            std::mutex _error_mutex;
+            std::exception_ptr _error;
+        };
+
+        /// @brief Starts threads workers.
+        explicit TaskPool(unsigned threads = std::thread::hardware_concurrency()) {
+            threads = std::max(threads, 1u);
+            for (unsigned i = 0; i < threads; i++)
+                _deques.push_back(std::make_unique<WorkStealingDeque<Task*>>());
+            for (unsigned i = 0; i < threads; i++)
+                _workers.emplace_back([this, i] { _work(i); });
+        }
+
+        TaskPool(const TaskPool&)            = delete;
+        TaskPool& operator=(const TaskPool&) = delete;
+
+        /// @brief Waits for all the tasks, then stops the workers.
+        ~TaskPool() {
+            _help_until([this] { return _pending.load() == 0; });
+            {
+                std::lock_guard<std::mutex> lock(_sleep_mutex);
+                _stop = true;
+                _epoch++;
+            }
+            _wake.notify_all();
+            for (auto& worker : _workers) worker.join();
+        }
+
+        /// @brief Returns the number of workers.
+        unsigned size() const noexcept { return unsigned(_workers.size()); }
+
+        /// @brief Submits fn as a task of the pool.
+        template <class Fn>
+        void submit(Fn&& fn) {
+            _submit(new Task{std::function<void()>(std::forward<Fn>(fn)), nullptr});
+        }
+
+        /// @brief Returns once every task submitted so far, and every task
+        /// they submit, has finished. The first exception thrown by a task
+        /// that does not belong to a group is rethrown here. Must not be
+        /// called from a task, which would wait for itself; use TaskGroup
+        /// there.
+        void wait_all() {
+            _help_until([this] { return _pending.load(std::memory_order_acquire) == 0; });
+            std::lock_guard<std::mutex> lock(_error_mutex);
+            if (_error) std::rethrow_exception(std::exchange(_error, nullptr));
+        }
+
+        /// @brief Calls fn(i) for every i of [first, last). The range is split
+        /// in halves down to grain indices, and the halves are left in the
+        /// deque of the splitting thread for others to steal.
+        /// @param first,last range of indices
+        /// @param fn callable taking an index
+        /// @param grain largest range run as one task
+        template <class Index, class Fn>
+        void parallel_for(Index first, Index last, Fn fn, Index grain = 1) {
+            // declared before group, whose destructor waits for the tasks
+            // using split, also when fn throws on this thread
+            std::function<void(Index, Index)> split;
+            TaskGroup group(*this);
+            grain = std::max(grain, Index(1));
+            split = [&](Index lo, Index hi) {
+                while (hi - lo > grain) {
+                    Index mid = lo + (hi - lo) / 2;
+                    group.run([&split, mid, hi] { split(mid, hi); });
+                    hi = mid;
+                }
+                for (; lo < hi; lo++) fn(lo);
+            };
+            split(first, last);
+            group.wait();
+        }
+
+    private:
+        struct Task {
+            std::function<void()> fn;
+            TaskGroup* group;
+        };
+
+        std::vector<std::unique_ptr<WorkStealingDeque<Task*>>> _deques;
+        ConcurrentDeque<Task*> _injected;
+        std::vector<std::thread> _workers;
+        std::atomic<std::size_t> _pending{0};
+        std::mutex _error_mutex;
+        std::exception_ptr _error;
+
+        std::mutex _sleep_mutex;
+        std::condition_variable _wake;
+        std::atomic<unsigned> _sleeping{0};
+        std::uint64_t _epoch = 0;  // bumped under _sleep_mutex to wake sleepers
+        bool _stop = false;
+
+        // threads that are not workers sleep here in _park_until
+        std::mutex _park_mutex;
+        std::condition_variable _finished;
+        std::atomic<unsigned> _parked{0};
+
+        // the worker running on this thread, if any
+        inline static thread_local TaskPool* _current_pool = nullptr;
+        inline static thread_local unsigned _current_index = 0;
+        inline static thread_local std::uint32_t _random    = 2463534242u;
+
+        bool _on_worker() const noexcept { return _current_pool == this; }
+
+        void _submit(Task* task) {
+            _pending.fetch_add(1, std::memory_order_relaxed);
+            if (_on_worker()) _deques[_current_index]->push_back(task);
+            else _injected.push_back(task);
+            // pairs with the fetch_add in _idle: either a sleeper sees the
+            // task, or we see the sleeper
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_sleeping.load(std::memory_order_relaxed) > 0) {
+                {
+                    std::lock_guard<std::mutex> lock(_sleep_mutex);
+                    _epoch++;
+                }
+                _wake.notify_one();
+            }
+        }
+
+        /// @brief Takes a task: the own deque first, then the shared queue,
+        /// then the other deques starting from a random victim.
+        Task* _find_task() {
+            Task* task;
+            if (_on_worker() && _deques[_current_index]->try_pop_back(task)) return task;
+            if (_injected.try_pop_front(task)) return task;
+            _random ^= _random << 13;
+            _random ^= _random >> 17;
+            _random ^= _random << 5;
+            std::size_t victim = _random % _deques.size();
+            for (std::size_t i = 0; i < _deques.size(); i++) {
+                std::size_t index = (victim + i) % _deques.size();
+                if (_on_worker() && index == _current_index) continue;
+                if (_deques[index]->try_steal(task)) return task;
+            }
+            return nullptr;
+        }
+
+        void _execute(Task* task) {
+            try {
+                task->fn();
+            } catch (...) {
+                if (task->group) {
+                    std::lock_guard<std::mutex> lock(task->group->_error_mutex);
+                    if (!task->group->_error) task->group->_error = std::current_exception();
+                } else {
+                    std::lock_guard<std::mutex> lock(_error_mutex);
+                    if (!_error) _error = std::current_exception();
+                }
+            }
+            TaskGroup* group = task->group;
+            delete task;
+            // group may be destroyed by its waiter as soon as its count drops
+            bool finished = group && group->_pending.fetch_sub(1, std::memory_order_release) == 1;
+            finished |= _pending.fetch_sub(1, std::memory_order_release) == 1;
+            if (finished) {
+                // pairs with the fetch_add in _park_until: either the parked
+                // thread sees the count, or we see the parked thread
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (_parked.load(std::memory_order_relaxed) > 0) {
+                    { std::lock_guard<std::mutex> lock(_park_mutex); }
+                    _finished.notify_all();
+                }
+            }
+        }
+
+        static void _cpu_relax() noexcept {
+#ifdef LAB_DEQUE_X86_SIMD
+            _mm_pause();
+#else
+            std::this_thread::yield();
+#endif
+        }
+
+        /// @brief Runs tasks until done() returns true, backing off while
+        /// there is nothing to run. Other threads do not run tasks: they have
+        /// no deque of their own, so the tasks they spawn would go to the
+        /// shared queue and come back FIFO, each nesting one more wait on the
+        /// stack. After spinning and yielding they park in _park_until.
+        /// done() must only become true when a pending count reaches zero.
+        template <class Done>
+        void _help_until(Done done) {
+            unsigned backoff = 1;
+            while (!done()) {
+                if (Task* task = _on_worker() ? _find_task() : nullptr) {
+                    _execute(task);
+                    backoff = 1;
+                } else if (backoff <= 64) {
+                    for (unsigned i = 0; i < backoff; i++) _cpu_relax();
+                    backoff *= 2;
+                } else if (backoff > 1024 && !_on_worker()) {
+                    _park_until(done);
+                } else {
+                    std::this_thread::yield();
+                    if (backoff <= 1024) backoff *= 2;
+                }
+            }
+        }
+
+        /// @brief Blocks a thread that is not a worker until done() returns
+        /// true. _execute wakes it whenever a pending count reaches zero.
+        template <class Done>
+        void _park_until(Done& done) {
+            _parked.fetch_add(1, std::memory_order_seq_cst);
+            {
+                std::unique_lock<std::mutex> lock(_park_mutex);
+                _finished.wait(lock, done);
+            }
+            _parked.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        /// @brief Sleeps until a task is submitted or the pool stops, unless a
+        /// task shows up in the meantime, which is then returned.
+        Task* _idle() {
+            _sleeping.fetch_add(1, std::memory_order_seq_cst);
+            std::uint64_t epoch;
+            {
+                std::lock_guard<std::mutex> lock(_sleep_mutex);
+                epoch = _epoch;
+            }
+            Task* task = _find_task();
+            if (!task) {
+                std::unique_lock<std::mutex> lock(_sleep_mutex);
+                _wake.wait(lock, [&] { return _stop || _epoch != epoch; });
+            }
+            _sleeping.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+
+        void _work(unsigned index) {
+            _current_pool  = this;
+            _current_index = index;
+            _random += index * 2654435761u;
+            unsigned backoff = 1;
+            while (true) {
+                Task* task = _find_task();
+                if (!task) {
+                    if (backoff <= 64) {
+                        for (unsigned i = 0; i < backoff; i++) _cpu_relax();
+                        backoff *= 2;
+                        continue;
+                    }
+                    if (backoff <= 1024) {
+                        std::this_thread::yield();
+                        backoff *= 2;
+                        continue;
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(_sleep_mutex);
+                        if (_stop) return;
+                    }
+                    task    = _idle();
+                    backoff = 1;
+                    if (!task) continue;
+                }
+                backoff = 1;
+                _execute(task);
+            }
+        }
+    };
+}  // namespace lab
@@ -0,0 +1,223 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "deque.h"
+
+namespace lab {
+    /// @brief Chase-Lev work-stealing deque. One owner thread pushes and pops
+    /// at the back without locks; any number of thieves steal from the front
+    /// with a CAS on the top index. T must be trivially copyable, as in the
+    /// original algorithm a thief may read a slot the owner is overwriting and
+    /// throws the value away when its CAS fails; task handles and pointers are
+    /// the intended element types.
+    ///
+    /// The storage is a ring of CHUNK_SIZE-element chunks reached through a
+    /// map of chunk pointers, like the map of Deque. Growing doubles the map
+    /// only: the chunks holding elements move to their new slots by pointer
+    /// and new chunks fill the rest, so no element is copied. Thieves that
+    /// still use the old map find the same chunks there; old maps are kept
+    /// until the deque is destroyed.
+    template <typename T, typename Allocator = Allocator<T>>
+    class WorkStealingDeque {
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "WorkStealingDeque needs trivially copyable elements");
+
+    public:
+        using value_type     = T;
+        using allocator_type = Allocator;
+        using size_type      = std::size_t;
+
+        const static size_type CHUNK_SIZE =
+                512 / sizeof(T) == 0 ? 1 : 512 / sizeof(T);
+
+        explicit WorkStealingDeque(const Allocator& alloc = Allocator())
+                : _alloc_c(alloc), _alloc_m(alloc) {
+            Map* map = _new_map(4);
+            for (size_type i = 0; i < map->capacity; i++) map->chunks[i] = _new_chunk();
+            _map.store(map, std::memory_order_relaxed);
+        }
+
+        WorkStealingDeque(const WorkStealingDeque&)            = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+        ~WorkStealingDeque() {
+            Map* map = _map.load(std::memory_order_relaxed);
+            for (size_type i = 0; i < map->capacity; i++)
+                _alloc_c.deallocate(map->chunks[i], 1);
+            _delete_map(map);
+            for (Map* old : _retired) _delete_map(old);
+        }
+
+        /// OWNER
+
+        /// @brief Pushes value at the back. Owner only.
+        void push_back(const T& value) {
+            std::int64_t bottom = _bottom.load(std::memory_order_relaxed);
+            Map* map            = _map.load(std::memory_order_relaxed);
+            if (bottom - _top_cache >= std::int64_t(_capacity(map))) {
+                std::int64_t top = _refresh_top();
+                if (bottom - top >= std::int64_t(_capacity(map))) map = _grow(map, top, bottom);
+            }
+            _slot(map, bottom).store(value, std::memory_order_relaxed);
+            _bottom.store(bottom + 1, std::memory_order_release);
+        }
+
+        /// @brief Pushes the elements of values at the back, in order, and
+        /// publishes them to thieves with a single release store. The map is
+        /// grown at most once per doubling for the whole batch. Owner only.
+        void push_back_n(std::span<const T> values) {
+            std::int64_t bottom = _bottom.load(std::memory_order_relaxed);
+            Map* map            = _map.load(std::memory_order_relaxed);
+            std::int64_t n      = std::int64_t(values.size());
+            if (bottom + n - _top_cache > std::int64_t(_capacity(map))) {
+                std::int64_t top = _refresh_top();
+                while (bottom + n - top > std::int64_t(_capacity(map)))
+                    map = _grow(map, top, bottom);
+            }
+            for (std::int64_t i = 0; i < n; i++)
+                _slot(map, bottom + i).store(values[i], std::memory_order_relaxed);
+            _bottom.store(bottom + n, std::memory_order_release);
+        }
+
+        /// @brief Pops the last element into out. Owner only.
+        /// @return false if the deque was empty or the last element was
+        /// stolen meanwhile.
+        bool try_pop_back(T& out) {
+            std::int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            Map* map            = _map.load(std::memory_order_relaxed);
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t top = _top.load(std::memory_order_relaxed);
+            if (top > bottom) {
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return false;
+            }
+            out = _slot(map, bottom).load(std::memory_order_relaxed);
+            if (top < bottom) return true;
+            // the last element: race the thieves for it
+            bool won = _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+
+        /// THIEVES
+
+        /// @brief Steals the first element into out. Any thread.
+        /// @return false if the deque was empty or another thread took the
+        /// element first; callers that need an element retry.
+        bool try_steal(T& out) {
+            std::int64_t top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t bottom = _bottom.load(std::memory_order_acquire);
+            if (top >= bottom) return false;
+            Map* map = _map.load(std::memory_order_acquire);
+            T value  = _slot(map, top).load(std::memory_order_relaxed);
+            if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed))
+                return false;
+            out = value;
+            return true;
+        }
+
+        /// @brief Returns a snapshot of the number of elements.
+        size_type size() const noexcept {
+            std::int64_t bottom = _bottom.load(std::memory_order_relaxed);
+            std::int64_t top    = _top.load(std::memory_order_relaxed);
+            return bottom > top ? size_type(bottom - top) : 0;
+        }
+
+        bool empty() const noexcept { return size() == 0; }
+
+    private:
+        using Chunk = std::atomic<T>[CHUNK_SIZE];
+
+        struct Map {
+            size_type capacity;  // a power of two
+            Chunk** chunks;
+        };
+
+        using chunk_allocator =
+                typename std::allocator_traits<Allocator>::template rebind_alloc<Chunk>;
+        using map_allocator =
+                typename std::allocator_traits<Allocator>::template rebind_alloc<Chunk*>;
+
+        chunk_allocator _alloc_c;
+        map_allocator _alloc_m;
+        std::atomic<Map*> _map;
+        std::vector<Map*> _retired;  // owner only
+        // thieves write _top, the owner writes _bottom and keeps a copy of
+        // _top next to it; each on cache lines of its own
+        alignas(CACHE_LINE_SIZE) std::atomic<std::int64_t> _top{0};
+        alignas(CACHE_LINE_SIZE) std::atomic<std::int64_t> _bottom{0};
+        std::int64_t _top_cache = 0;
+
+        /// @brief Number of elements the map can hold. One chunk is left over
+        /// so that the live indices never reach two chunks sharing a slot.
+        static size_type _capacity(const Map* map) noexcept {
+            return (map->capacity - 1) * CHUNK_SIZE;
+        }
+
+        static std::atomic<T>& _slot(Map* map, std::int64_t index) noexcept {
+            size_type i = size_type(index);
+            return (*map->chunks[(i / CHUNK_SIZE) & (map->capacity - 1)])[i % CHUNK_SIZE];
+        }
+
+        Chunk* _new_chunk() {
+            Chunk* chunk = _alloc_c.allocate(1);
+            for (size_type i = 0; i < CHUNK_SIZE; i++)
+                ::new (static_cast<void*>(&(*chunk)[i])) std::atomic<T>();
+            return chunk;
+        }
+
+        Map* _new_map(size_type capacity) {
+            Map* map    = new Map{capacity, nullptr};
+            map->chunks = _alloc_m.allocate(capacity);
+            return map;
+        }
+
+        void _delete_map(Map* map) noexcept {
+            _alloc_m.deallocate(map->chunks, map->capacity);
+            delete map;
+        }
+
+        /// @brief Reloads the owner's copy of _top. Thieves only ever raise
+        /// _top, so a stale copy overstates the size and a push that fits by
+        /// the copy fits for real; and since the copy was loaded with acquire,
+        /// the thieves' reads of the slots below it happened before the owner
+        /// reuses them.
+        std::int64_t _refresh_top() noexcept {
+            return _top_cache = _top.load(std::memory_order_acquire);
+        }
+
+        /// @brief Publishes a map twice as large. The chunks of the indices
+        /// [top, bottom] keep their identity at their new slots, the other old
+        /// chunks and new ones take the remaining slots.
+        Map* _grow(Map* old, std::int64_t top, std::int64_t bottom) {
+            Map* map = _new_map(2 * old->capacity);
+            std::vector<bool> taken(map->capacity), reused(old->capacity);
+            for (size_type c = size_type(top) / CHUNK_SIZE; c <= size_type(bottom) / CHUNK_SIZE;
+                 c++) {
+                map->chunks[c & (map->capacity - 1)] = old->chunks[c & (old->capacity - 1)];
+                taken[c & (map->capacity - 1)]       = true;
+                reused[c & (old->capacity - 1)]      = true;
+            }
+            size_type next_old = 0;
+            for (size_type i = 0; i < map->capacity; i++) {
+                if (taken[i]) continue;
+                while (next_old < old->capacity && reused[next_old]) next_old++;
+                map->chunks[i] = next_old < old->capacity ? old->chunks[next_old++]
+                                                          : _new_chunk();
+            }
+            _retired.push_back(old);
+            _map.store(map, std::memory_order_release);
+            return map;
+        }
+    };
+}  // namespace lab
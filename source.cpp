@@ -1,14 +1,55 @@
 #include <assert.h>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <deque>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 #include "deque.h"
+#include "deque_algorithm.h"
+#include "deque_async.h"
+#include "deque_channel.h"
+#include "deque_concurrent.h"
+#include "deque_epoch.h"
+#include "deque_parallel.h"
+#include "deque_sharded.h"
+#include "deque_spsc.h"
+#include "deque_task_pool.h"
+#include "deque_work_stealing.h"
 
-using namespace lol;
+using namespace lab;
+
+// std::allocator that counts the allocations of each element type
+template <class T>
+struct CountingAllocator : std::allocator<T> {
+    static inline std::size_t allocations = 0;
+
+    CountingAllocator() = default;
+
+    template <class U>
+    CountingAllocator(const CountingAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        allocations++;
+        return std::allocator<T>::allocate(n);
+    }
+
+    template <class U>
+    struct rebind {
+        using other = CountingAllocator<U>;
+    };
+};
 
 int main() {
 
     {
-        Deque<int,Allocator<Node<int>>> a = Deque<int, Allocator<Node<int>>>();
+        Deque<int> a = Deque<int>();
         a.push_back(3);
         a.push_back(1);
         assert(3 == a[0]);
@@ -21,56 +62,59 @@ int main() {
 
     {
         std::deque<int> first = {1, 2, 3};
-        Deque<int,Allocator<Node<int>>> deq(first.begin(), first.end());
-        Deque_iterator<int> b = deq.begin();
-        Deque_iterator<int> c = deq.end();
-        Deque_reverse_iterator<Deque_iterator<int>> g = deq.rbegin();
-        Deque_reverse_iterator<Deque_iterator<int>> e = deq.rend();
+        Deque<int> deq(first.begin(), first.end());
+        Deque<int>::iterator b = deq.begin();
+        Deque<int>::iterator c = deq.end() - 1;
+        Deque<int>::reverse_iterator g = deq.rbegin();
+        Deque<int>::reverse_iterator e = deq.rend();
         assert(1 == *b++);
         assert(3 == *++b);
         assert(3 == *c);
         assert(b == c);
         assert(b >= c);
         assert(b <= c);
-        assert(1 == *g--);
-        assert(3 == *--g);
-        assert(2 == *++g);
-        assert(3 == *e);
+        assert(3 == *g++);
+        assert(1 == *++g);
+        assert(2 == *--g);
+        assert(1 == *--e);
+        assert(3 == deq.rend() - deq.rbegin());
     }
 
     {
         std::deque<int> v = {1, 2, 3, 5};
         std::initializer_list<int> ilist = {11, 12, 13, 15};
-        Deque<int,Allocator<Node<int>>> d(v.begin(), v.end());
-        Deque_const_iterator<int> it = d.cbegin();
+        Deque<int> d(v.begin(), v.end());
+        Deque<int>::const_iterator it = d.cbegin();
         it++;
         auto m = d.insert(it, 20);
-        auto n = d.insert(it, ilist);
+        auto n = d.insert(d.cbegin() + 2, ilist);
         assert(d[1] == 20);
         assert(20 == *m);
-        assert(15 == *n);
+        assert(11 == *n);
+        assert(15 == n[3]);
+        assert(2 == n[4]);
         assert(9 == d.size());
         assert(5 == d[8]);
     }
 
     {
         std::deque<int> v = {6, 2, 3, 6};
-        Deque<int, Allocator<Node<int>>> a(v.begin(), v.end());
+        Deque<int> a(v.begin(), v.end());
 
-        Deque_const_iterator<int> e = a.cbegin();
+        Deque<int>::const_iterator e = a.cbegin();
         e++;
         a.erase(e);
         assert(3 == a.size());
 
-        Deque_const_iterator<int> g = a.cbegin();
+        Deque<int>::const_iterator g = a.cbegin();
         a.erase(g);
         assert(2 == a.size());
 
-        Deque_const_iterator<int> d = a.cend();
+        Deque<int>::const_iterator d = a.cend() - 1;
         a.erase(d);
         assert(1 == a.size());
 
-        Deque_const_iterator<int> l = a.cend();
+        Deque<int>::const_iterator l = a.cend() - 1;
         a.erase(l);
         assert(0 == a.size());
 
@@ -89,8 +133,8 @@ int main() {
     {
         std::deque<int> v1 = {1,2,3,5};
         std::deque<int> v2 = {5,3,2,1};
-        Deque<int,Allocator<Node<int>>> a(v1.begin(), v1.end());
-        Deque<int,Allocator<Node<int>>> b(v2.begin(), v2.end());
+        Deque<int> a(v1.begin(), v1.end());
+        Deque<int> b(v2.begin(), v2.end());
 
         a.swap(b);
         assert(5 == a[0]);
@@ -112,8 +156,8 @@ int main() {
 
     {
         std::deque<int> v = {1,2,3};
-        Deque<int,Allocator<Node<int>>> deq1(v.begin(), v.end());
-        Deque<int,Allocator<Node<int>>> deq2(v.begin(), v.end());
+        Deque<int> deq1(v.begin(), v.end());
+        Deque<int> deq2(v.begin(), v.end());
 
         assert(deq1 == deq2);
         assert((deq1 != deq2) == false);
@@ -145,7 +189,7 @@ int main() {
 
     {
         std::deque<int> v = {1, 2, 3, 4};
-        Deque<int,Allocator<Node<int>>> d1(v.begin(), v.end());
+        Deque<int> d1(v.begin(), v.end());
 
         assert(d1.size() == 4);
         d1.resize(1);
@@ -170,6 +214,950 @@ int main() {
         assert(d.empty());
     }
 
+    {
+        // inserts near either end move only the shorter side
+        Deque<int> d;
+        for (int i = 0; i < 1000; i++) d.push_back(i);
+        auto it = d.insert(d.cbegin() + 10, 3, -1);
+        assert(1003 == d.size());
+        assert(-1 == *it && -1 == it[2] && 10 == it[3]);
+        assert(9 == d[9]);
+
+        std::vector<int> more = {-2, -3};
+        it = d.insert(d.cend() - 5, more.begin(), more.end());
+        assert(-2 == *it && -3 == it[1] && 995 == it[2]);
+        assert(999 == d.back());
+
+        Deque<std::string> s = {"b", "d"};
+        s.emplace(s.cbegin(), 1, 'a');
+        s.emplace(s.cbegin() + 2, "c");
+        s.insert(s.cend(), "e");
+        assert(5 == s.size());
+        assert("a" == s[0] && "b" == s[1] && "c" == s[2] && "d" == s[3] && "e" == s[4]);
+    }
+
+    {
+        Deque<int> d;
+        for (int i = 0; i < 1000; i++) d.push_back(i);
+
+        auto it = d.erase(d.cbegin() + 10, d.cbegin() + 20);
+        assert(990 == d.size());
+        assert(20 == *it);
+        assert(9 == d[9]);
+
+        it = d.erase(d.cend() - 100, d.cend());
+        assert(890 == d.size());
+        assert(it == d.end());
+        assert(899 == d.back());
+
+        d.erase(d.cbegin(), d.cbegin() + 500);
+        assert(390 == d.size());
+        assert(510 == d.front());
+
+        d.erase(d.cbegin() + 1);
+        assert(512 == d[1]);
+    }
+
+    {
+        Deque<int> d;
+        for (int i = 0; i < 1000; i++) d.push_back(i % 3);
+
+        assert(334 == erase(d, 0));
+        assert(666 == d.size());
+        assert(1 == d[0]);
+        assert(2 == d[1]);
+        assert(2 == d.back());
+
+        assert(333 == erase_if(d, [](int x) { return x == 2; }));
+        assert(333 == d.size());
+        assert(1 == d.front());
+        assert(1 == d.back());
+        assert(0 == erase(d, 7));
+
+        Deque<double> f;
+        for (int i = 0; i < 1000; i++) f.push_back(i % 4 == 0 ? -0.0 : i);
+        assert(250 == erase(f, 0.0));
+        assert(750 == f.size());
+        assert(1 == f[0]);
+        assert(5 == f[3]);
+        assert(999 == f.back());
+
+        Deque<long long> w;
+        for (int i = 0; i < 1000; i++) w.push_front(i % 5);
+        assert(200 == erase(w, 4LL));
+        assert(800 == w.size());
+        assert(3 == w.front());
+        assert(0 == w.back());
+
+        Deque<std::string> s = {"a", "b", "a", "c"};
+        assert(2 == erase(s, "a"));
+        assert("b" == s[0]);
+        assert("c" == s[1]);
+    }
+
+    {
+        Deque<int> d(1000);
+        assert(1000 == d.size());
+        assert(0 == d[999]);
+
+        d.resize(5000, 7);
+        assert(5000 == d.size());
+        assert(0 == d[999]);
+        assert(7 == d[1000]);
+        assert(7 == d.back());
+
+        d.resize(10);
+        assert(10 == d.size());
+        assert(0 == d.back());
+
+        Deque<std::string> s(3, "ab");
+        s.resize(300);
+        assert(300 == s.size());
+        assert("ab" == s[2]);
+        assert(s.back().empty());
+    }
+
+    {
+        Deque<int> d;
+        for (int frame = 0; frame < 10; frame++) {
+            for (int i = 0; i < 1000; i++) d.push_back(i);
+            for (int i = 0; i < 1000; i++) d.push_front(i);
+            assert(2000 == d.size());
+            d.clear(8);
+            assert(d.empty());
+        }
+        d.push_back(1);
+        d.push_front(2);
+        assert(2 == d.front());
+        assert(1 == d.back());
+
+        d.clear_and_release();
+        assert(d.empty());
+        d.push_back(3);
+        assert(3 == d.front());
+
+        Deque<std::string> s(500, "abc");
+        s.clear();
+        assert(s.empty());
+        s.push_back("x");
+        assert("x" == s.front());
+    }
+
+    {
+        // clearing a moved-from deque must not touch the new owner's storage
+        Deque<int> a;
+        for (int i = 0; i < 1000; i++) a.push_back(i);
+        Deque<int> b(std::move(a));
+        assert(a.empty());
+        a.clear();
+        assert(a.empty());
+        assert(1000 == b.size() && 999 == b.back());
+
+        Deque<int> c;
+        c = std::move(b);
+        b.clear();
+        assert(b.empty());
+        c.clear();
+        c.push_back(7);
+        assert(7 == c.front());
+        b = std::move(c);
+        assert(1 == b.size());
+    }
+
+    {
+        Deque<int> d;
+        int next = 0;
+        d.emplace_back_n(1000, [&next] { return next++; });
+        assert(1000 == d.size());
+        assert(0 == d[0]);
+        assert(999 == d.back());
+
+        d.generate_front(300, [&next] { return next++; });
+        assert(1300 == d.size());
+        assert(1000 == d.front());
+        assert(1299 == d[299]);
+        assert(0 == d[300]);
+
+        Deque<std::pair<int, std::string>> p;
+        p.emplace_back(1, "one");
+        p.emplace_front(0, "zero");
+        assert(0 == p.front().first);
+        assert("one" == p.back().second);
+    }
+
+    {
+        Deque<int> a, b;
+        for (int i = 0; i < 1000; i++) a.push_back(i);
+        for (int i = 999; i >= 0; i--) b.push_front(i);
+        assert(a == b);
+        assert(a <= b);
+        assert(a >= b);
+
+        b[700] = 0;
+        assert(a != b);
+        assert(b < a);
+        assert(a > b);
+
+        b[700] = 700;
+        b.pop_back();
+        assert(b < a);
+        assert(b != a);
+
+        Deque<double> x(100, 1.5), y(100, 1.5);
+        assert(x == y);
+        y.back() = 2.5;
+        assert(x < y);
+    }
+
+    {
+        Deque<int> a = {1, 2, 3}, b = {1, 2, 4}, c = {1, 2};
+        assert((a <=> b) < 0);
+        assert((b <=> a) > 0);
+        assert((a <=> a) == 0);
+        assert((c <=> a) < 0);
+        assert(a < b && c < a && b > c);
+
+        Deque<double> x = {1.0, 0.0 / 0.0}, y = {1.0, 2.0};
+        assert((x <=> y) == std::partial_ordering::unordered);
+
+        assert((a.begin() <=> a.end()) < 0);
+        assert(a.begin() + 3 == a.end());
+        assert(a.end() - 1 > a.begin());
+    }
+
+    {
+        Deque<int> d;
+        for (int i = 0; i < 1000; i++) d.push_back(i % 100);
+        d.push_front(-1);
+
+        assert(d.begin() == d.find(-1));
+        assert(d.begin() + 51 == d.find(50));
+        assert(d.end() == d.find(100));
+        assert(10 == d.count(7));
+        assert(d.contains(99));
+        assert(!d.contains(1000));
+        assert(d.begin() + 100 == d.find_if([](int x) { return x > 98; }));
+
+        const Deque<char> c = {'a', 'b', 'c'};
+        assert('b' == *c.find('b'));
+        assert(1 == c.count('c'));
+
+        Deque<float> f;
+        for (int i = 0; i < 1000; i++) f.push_back(float(i % 100) / 4);
+        f.push_back(0.0f / 0.0f);
+        f.push_back(-0.0f);
+        assert(f.begin() + 30 == f.find(7.5f));
+        assert(10 == f.count(7.5f));
+        assert(11 == f.count(0.0f));
+        assert(f.end() == f.find(0.0f / 0.0f));
+        assert(f.end() == f.find(100.0f));
+
+        Deque<double> g(f.begin(), f.end());
+        assert(g.begin() + 99 == g.find(24.75));
+        assert(0 == g.count(0.0 / 0.0));
+    }
+
+    {
+        Deque<double> d;
+        for (int i = 1; i <= 1000; i++) d.push_back(i);
+        d.push_front(-5);
+
+        assert(500500 - 5 == sum(d));
+        assert(500500 - 5 == sum(reassociate, d));
+        assert(-5 == min(d));
+        assert(1000 == max(d));
+        assert(std::make_pair(-5.0, 1000.0) == minmax(d));
+        assert(1 == reduce(Deque<int>{}, 1, std::multiplies<>()));
+        assert(24 == reduce(Deque<int>{1, 2, 3, 4}, 1, std::multiplies<>()));
+    }
+
+    {
+        Deque<int> d;
+        for (int i = 0; i < 100000; i++) d.push_back(i % 10);
+
+        for_each(par, d, [](int& x) { x++; });
+        assert(1 == d.front());
+        assert(10 == d.back());
+
+        assert(550000 == reduce(par, d, 0, std::plus<>()));
+        assert(550000 == reduce(par(3), d, 0, std::plus<>()));
+        assert(10000 == count_if(par, d, [](int x) { return x == 5; }));
+
+        Deque<long long> squares;
+        transform(par(4), d, squares, [](int x) { return (long long) x * x; });
+        assert(100000 == squares.size());
+        assert(100 == squares.back());
+        assert(4 == squares[1]);
+    }
+
+    {
+        Deque<int> d;
+        for (int i = 0; i < 10000; i++) d.push_back((i * 7919) % 10007);
+        Deque<int> e = d;
+
+        sort(d);
+        for (int i = 1; i < 10000; i++) assert(d[i - 1] <= d[i]);
+
+        sort(par(3), e);
+        assert(d == e);
+
+        sort(par, e, std::greater<>());
+        assert(e.front() == d.back());
+        assert(e.back() == d.front());
+
+        // the scratch buffer is uninitialized, so T needs no default ctor
+        Deque<std::reference_wrapper<const int>> refs(e.begin(), e.end());
+        Deque<std::reference_wrapper<const int>> par_refs = refs;
+        sort(refs, std::less<int>());
+        sort(par(3), par_refs, std::less<int>());
+        for (int i = 0; i < 10000; i++) assert(d[i] == refs[i] && d[i] == par_refs[i]);
+
+        Deque<std::string> s;
+        for (int i = 0; i < 3000; i++) s.push_back(std::string(20, char('a' + i * 7 % 26)));
+        Deque<std::string> par_s = s;
+        sort(s);
+        sort(par(3), par_s);
+        assert(s == par_s);
+        assert(std::string(20, 'a') == s.front());
+        assert(std::string(20, 'z') == s.back());
+    }
+
+    {
+        Deque<int> d;
+        for (int i = 0; i < 5000; i++) d.push_front(5000 - i);
+        for (int i = 1; i <= 5000; i++) d.push_back(5000 + i / 2);
+
+        assert(d.begin() == d.lower_bound(-1));
+        assert(d.end() == d.upper_bound(8000));
+        assert(99 == d.lower_bound(100) - d.begin());
+        assert(100 == d.upper_bound(100) - d.begin());
+        assert(4999 == d.lower_bound(5000) - d.begin());
+        assert(5001 == d.upper_bound(5000) - d.begin());
+        assert(5000 + 2 * 500 - 1 == d.lower_bound(5500) - d.begin());
+
+        ChunkHeadIndex index(d);
+        for (int v = -1; v < 8000; v += 37) {
+            assert(index.lower_bound(v) == d.lower_bound(v));
+            assert(index.upper_bound(v) == d.upper_bound(v));
+        }
+
+        Deque<int> reversed;
+        for (int x : d) reversed.push_front(x);
+        assert(reversed.begin() + 9900 ==
+               reversed.lower_bound(100, std::greater<>()));
+    }
+
+    {
+        Deque<int> d;
+        for (int i = 0; i < 128 * 40; i++) d.push_back(i);
+        d.pop_front();
+        d.push_back(128 * 40);
+
+        auto old_first = d.rotate(1000);
+        assert(1001 == d.front());
+        assert(1000 == d.back());
+        assert(1 == *old_first);
+        assert(old_first == d.begin() + (d.size() - 1000));
+
+        d.rotate(d.size() - 1000);
+        for (int i = 0; i < 128 * 40; i++) assert(i + 1 == d[i]);
+
+        d.pop_back();
+        rotate(d, d.cbegin() + 3);
+        assert(4 == d.front());
+        assert(3 == d.back());
+        assert(d.end() == rotate(d, d.cbegin()));
+        assert(d.begin() == d.rotate(d.size()));
+
+        Deque<std::string> s;
+        std::vector<std::string> v;
+        for (int i = 0; i < 1001; i++) {
+            s.push_back(std::to_string(i));
+            v.push_back(std::to_string(i));
+        }
+        s.rotate(300);
+        std::rotate(v.begin(), v.begin() + 300, v.end());
+        assert(std::equal(v.begin(), v.end(), s.begin(), s.end()));
+        s.rotate(s.size() - 77);
+        std::rotate(v.begin(), v.end() - 77, v.end());
+        assert(std::equal(v.begin(), v.end(), s.begin(), s.end()));
+    }
+
+    {
+        Deque<int> a, b;
+        for (int i = 0; i < 128 * 10; i++) a.push_back(i);
+        for (int i = 0; i < 1000; i++) b.push_back(128 * 10 + i);
+        a.splice_back(std::move(b));
+        assert(b.empty());
+        assert(128 * 10 + 1000 == a.size());
+        for (int i = 0; i < 128 * 10 + 1000; i++) assert(i == a[i]);
+
+        Deque<int> c;
+        for (int i = 1; i <= 300; i++) c.push_front(-i);
+        a.splice_front(std::move(c));
+        assert(c.empty());
+        assert(-300 == a.front());
+        assert(0 == a[300]);
+
+        c.push_back(1);
+        a.splice_back(std::move(c));
+        assert(1 == a.back());
+        c.splice_front(std::move(a));
+        assert(a.empty());
+        assert(-300 == c.front());
+
+        Deque<std::string> s1(3, "a"), s2(5, "b");
+        s1.splice_front(std::move(s2));
+        assert(8 == s1.size());
+        assert("b" == s1.front());
+        assert("a" == s1.back());
+    }
+
+    {
+        // chunks that are not aligned: the smaller side is moved into the
+        // chunks it gives up, and the larger side keeps its storage
+        using CountedDeque = Deque<int, CountingAllocator<int>>;
+        auto& allocations  = CountingAllocator<int>::allocations;
+        CountedDeque a, b, c, d;
+        for (int i = 0; i < 128 * 20 + 5; i++) a.push_back(i);
+        for (int i = 0; i < 128 * 10 + 40; i++) b.push_back(128 * 20 + 5 + i);
+        for (int i = 1; i <= 300; i++) c.push_front(-i);
+
+        const int* a_front = &a.front();
+        std::size_t before = allocations;
+        a.splice_back(std::move(b));
+        assert(allocations - before <= 1);
+        assert(&a.front() == a_front);
+        assert(b.empty());
+
+        const int* a_back = &a.back();
+        before = allocations;
+        a.splice_front(std::move(c));
+        assert(allocations - before <= 1);
+        assert(&a.back() == a_back);
+        assert(c.empty());
+
+        for (int i = 0; i < 7; i++) d.push_back(-307 + i);
+        a_back = &a.back();
+        before = allocations;
+        d.splice_back(std::move(a));
+        assert(allocations - before <= 1);
+        assert(&d.back() == a_back);
+        for (int i = 0; i < int(d.size()); i++) assert(i - 307 == d[i]);
+    }
+
+    {
+        Deque<int> d;
+        for (int i = 0; i < 10000; i++) d.push_back(i);
+
+        Deque<int> tail = d.split_at(d.cbegin() + 6000);
+        assert(6000 == d.size());
+        assert(4000 == tail.size());
+        assert(5999 == d.back());
+        assert(6000 == tail.front());
+        assert(9999 == tail.back());
+        d.push_back(-1);
+        tail.push_front(-2);
+        assert(-1 == d[6000]);
+        assert(6000 == tail[1]);
+
+        Deque<int> all = d.split_at(d.cbegin());
+        assert(d.empty());
+        assert(6001 == all.size());
+        assert(all.split_at(all.cend()).empty());
+
+        auto pieces = all.split_into(4);
+        assert(4 == pieces.size());
+        assert(all.empty());
+        assert(1501 == pieces[0].size());
+        assert(1500 == pieces[3].size());
+        assert(1501 == pieces[1].front());
+        assert(-1 == pieces[3].back());
+    }
+
+    {
+        SpscDeque<int> queue;
+        const int n = 100000;
+        std::thread producer([&] {
+            for (int i = 0; i < n; i++) queue.push_back(i);
+        });
+        long long total = 0;
+        for (int expected = 0; expected < n;) {
+            int value;
+            if (!queue.try_pop_front(value)) {
+                std::this_thread::yield();
+                continue;
+            }
+            assert(expected == value);
+            total += value;
+            expected++;
+        }
+        producer.join();
+        assert(queue.empty());
+        assert((long long) n * (n - 1) / 2 == total);
+
+        SpscDeque<std::string> strings;
+        for (int i = 0; i < 1000; i++) strings.push_back(std::to_string(i));
+        std::string s;
+        assert(strings.try_pop_front(s));
+        assert("0" == s);
+        assert(999 == strings.size());
+    }
+
+    {
+        ConcurrentDeque<int> deque;
+        const int per_thread = 20000;
+        std::vector<std::thread> threads;
+        std::atomic<long long> popped_sum{0};
+        for (int t = 0; t < 4; t++)
+            threads.emplace_back([&, t] {
+                for (int i = 1; i <= per_thread; i++) {
+                    if ((i + t) % 2) deque.push_back(i);
+                    else deque.push_front(i);
+                    int value;
+                    if (i % 3 == 0 && (t % 2 ? deque.try_pop_front(value)
+                                              : deque.try_pop_back(value)))
+                        popped_sum += value;
+                }
+            });
+        for (auto& thread : threads) thread.join();
+
+        long long rest = 0;
+        int value;
+        while (deque.try_pop_front(value)) rest += value;
+        assert(deque.empty());
+        assert(4LL * per_thread * (per_thread + 1) / 2 == popped_sum + rest);
+
+        deque.push_back(1);
+        deque.push_front(0);
+        deque.push_back(2);
+        assert(3 == deque.size());
+        assert(deque.try_pop_back(value) && 2 == value);
+        assert(deque.try_pop_front(value) && 0 == value);
+        assert(deque.try_pop_back(value) && 1 == value);
+        assert(!deque.try_pop_front(value));
+    }
+
+    {
+        // every element is taken exactly once, and each thief sees the
+        // elements in push order
+        WorkStealingDeque<int> deque;
+        const int n = 200000;
+        std::atomic<bool> done{false};
+        std::vector<std::vector<int>> taken(4);
+        std::vector<std::thread> thieves;
+        for (int t = 0; t < 3; t++)
+            thieves.emplace_back([&, t] {
+                int value;
+                while (true) {
+                    bool last_round = done;
+                    if (deque.try_steal(value)) {
+                        assert(taken[t].empty() || taken[t].back() < value);
+                        taken[t].push_back(value);
+                    } else if (last_round && deque.empty()) {
+                        break;
+                    }
+                }
+            });
+        int value;
+        for (int i = 0; i < n; i++) {
+            deque.push_back(i);
+            if (i % 3 == 0 && deque.try_pop_back(value)) taken[3].push_back(value);
+        }
+        done = true;
+        for (auto& thief : thieves) thief.join();
+        while (deque.try_pop_back(value)) taken[3].push_back(value);
+
+        std::vector<char> seen(n, 0);
+        int total = 0;
+        for (auto& values : taken)
+            for (int v : values) {
+                assert(!seen[v]);
+                seen[v] = 1;
+                total++;
+            }
+        assert(n == total);
+
+        for (int i = 0; i < 1000; i++) deque.push_back(i);
+        assert(deque.try_pop_back(value) && 999 == value);
+        assert(deque.try_steal(value) && 0 == value);
+        assert(998 == deque.size());
+    }
+
+    {
+        // the owner's copy of top goes stale while thieves steal; pushes past
+        // it must reload top and reuse the stolen slots rather than grow or
+        // overwrite live ones
+        WorkStealingDeque<int> deque;
+        const int n = 4 * int(WorkStealingDeque<int>::CHUNK_SIZE);
+        int value;
+        for (int i = 0; i < n; i++) deque.push_back(i);
+        for (int i = 0; i < n - 10; i++) assert(deque.try_steal(value) && i == value);
+        for (int i = n; i < 2 * n; i++) deque.push_back(i);
+        std::vector<int> batch(n);
+        std::iota(batch.begin(), batch.end(), 2 * n);
+        for (int i = n - 10; i < 2 * n; i++) assert(deque.try_steal(value) && i == value);
+        deque.push_back_n(batch);
+        for (int i = 2 * n; i < 3 * n; i++) assert(deque.try_steal(value) && i == value);
+        assert(deque.empty());
+    }
+
+    {
+        TaskPool pool(4);
+        std::atomic<int> sum{0};
+        for (int i = 1; i <= 100; i++) pool.submit([&sum, i] { sum += i; });
+        pool.wait_all();
+        assert(5050 == sum);
+
+        std::function<long(int)> fib = [&](int n) -> long {
+            if (n < 10) return n < 2 ? n : fib(n - 1) + fib(n - 2);
+            long a, b;
+            TaskPool::TaskGroup group(pool);
+            group.run([&] { a = fib(n - 1); });
+            b = fib(n - 2);
+            group.wait();
+            return a + b;
+        };
+        assert(832040 == fib(30));
+
+        // the main thread is not a worker, so it parks until the task is done
+        std::atomic<bool> slept{false};
+        {
+            TaskPool::TaskGroup slow(pool);
+            slow.run([&slept] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                slept = true;
+            });
+            slow.wait();
+            assert(slept);
+        }
+
+        Deque<int> d(100000, 1);
+        std::vector<long> partial(64);
+        pool.parallel_for(0, 64, [&](int part) {
+            auto first = chunk_partition_point(d.begin(), d.end(), part, 64);
+            auto last  = chunk_partition_point(d.begin(), d.end(), part + 1, 64);
+            for (; first != last; ++first) partial[part] += *first;
+        });
+        assert(100000 == std::accumulate(partial.begin(), partial.end(), 0L));
+
+        // fn throwing on the calling thread, with the other halves still
+        // queued, must wait for them before parallel_for unwinds
+        std::atomic<int> visited{0};
+        bool thrown_here = false;
+        try {
+            pool.parallel_for(0, 1 << 16, [&](int i) {
+                if (i == 0) throw std::runtime_error("index 0");
+                visited++;
+            });
+        } catch (const std::runtime_error&) {
+            thrown_here = true;
+        }
+        assert(thrown_here);
+        assert(visited == (1 << 16) - 1);
+
+        pool.submit([] { throw std::runtime_error("task failed"); });
+        bool thrown = false;
+        try {
+            pool.wait_all();
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    {
+        std::vector<int> values(3000);
+        std::iota(values.begin(), values.end(), 0);
+        Deque<int> d;
+        d.push_back_n(values);
+        d.push_front_n(std::span<const int>(values).first(1000));
+        assert(4000 == d.size());
+        assert(0 == d.front());
+        assert(999 == d[999]);
+        assert(0 == d[1000]);
+        assert(2999 == d.back());
+
+        std::vector<int> out;
+        d.pop_front_n(1500, std::back_inserter(out));
+        assert(1500 == out.size());
+        assert(999 == out[999] && 0 == out[1000] && 499 == out[1499]);
+        assert(500 == d.front());
+        out.clear();
+        d.pop_back_n(700, std::back_inserter(out));
+        assert(2999 == out.front() && 2300 == out.back());
+        assert(2299 == d.back());
+        assert(1800 == d.size());
+        out.clear();
+        d.pop_front_n(5000, std::back_inserter(out));
+        assert(1800 == out.size() && d.empty());
+        d.push_back(7);
+        assert(7 == d.front());
+
+        Deque<std::string> strings;
+        std::vector<std::string> words{"a", "b", "c"};
+        strings.push_back_n(words);
+        strings.push_front_n(words);
+        std::vector<std::string> popped(4);
+        strings.pop_back_n(4, popped.begin());
+        assert("c" == popped[0] && "c" == popped[3]);
+        assert(2 == strings.size() && "b" == strings.back());
+
+        ConcurrentDeque<int> deque;
+        std::vector<std::thread> threads;
+        std::atomic<long long> popped_sum{0};
+        for (int t = 0; t < 4; t++)
+            threads.emplace_back([&, t] {
+                std::vector<int> batch(700, t + 1), got(300);
+                for (int round = 0; round < 50; round++) {
+                    if ((round + t) % 2) deque.push_back_n(batch);
+                    else deque.push_front_n(batch);
+                    auto end = t % 2 ? deque.pop_front_n(300, got.begin())
+                                     : deque.pop_back_n(300, got.begin());
+                    for (auto it = got.begin(); it != end; ++it) popped_sum += *it;
+                }
+            });
+        for (auto& thread : threads) thread.join();
+        std::vector<int> rest;
+        deque.pop_front_n(1 << 20, std::back_inserter(rest));
+        assert(deque.empty());
+        assert(50LL * 700 * (1 + 2 + 3 + 4) ==
+               popped_sum + std::accumulate(rest.begin(), rest.end(), 0LL));
+
+        deque.push_back_n(values);
+        deque.push_front_n(std::span<const int>(values).first(10));
+        out.clear();
+        deque.pop_front_n(12, std::back_inserter(out));
+        assert(0 == out[0] && 9 == out[9] && 1 == out[11]);
+        out.clear();
+        deque.pop_back_n(2, std::back_inserter(out));
+        assert(2999 == out[0] && 2998 == out[1]);
+
+        SpscDeque<int> queue;
+        std::thread producer([&] {
+            for (int round = 0; round < 100; round++) queue.push_back_n(values);
+        });
+        long long total = 0;
+        for (int expected = 0; expected < 100 * 3000;) {
+            out.clear();
+            queue.pop_front_n(1000, std::back_inserter(out));
+            for (int v : out) assert(expected++ % 3000 == v);
+            total += std::accumulate(out.begin(), out.end(), 0LL);
+        }
+        producer.join();
+        assert(100LL * 3000 * 2999 / 2 == total);
+
+        WorkStealingDeque<int> tasks;
+        tasks.push_back_n(values);
+        int value;
+        assert(3000 == tasks.size());
+        assert(tasks.try_steal(value) && 0 == value);
+        assert(tasks.try_pop_back(value) && 2999 == value);
+    }
+
+    {
+        // a batch allocates only the chunks past the ones the end already has
+        ConcurrentDeque<int, CountingAllocator<int>> deque;
+        const int chunk = int(ConcurrentDeque<int>::CHUNK_SIZE);
+        std::vector<int> values(3 * chunk);
+        std::iota(values.begin(), values.end(), 0);
+        CountingAllocator<int>::allocations = 0;
+        deque.push_back_n(std::span<const int>(values).first(10));
+        deque.push_front_n(std::span<const int>(values).first(10));
+        assert(0 == CountingAllocator<int>::allocations);
+        deque.push_back_n(values);
+        assert(3 == CountingAllocator<int>::allocations);
+        std::vector<int> out;
+        deque.pop_back_n(values.size(), std::back_inserter(out));
+        assert(out.front() == values.back() && out.back() == values.front());
+        assert(20 == deque.size());
+    }
+
+    {
+        Channel<int> channel(1);
+        assert(128 == channel.capacity());
+        for (int i = 0; i < 128; i++) assert(channel.try_push(i));
+        assert(!channel.try_push(128));
+        assert(!channel.push_for(128, std::chrono::milliseconds(1)));
+        int value;
+        assert(channel.pop(value) && 0 == value);
+        assert(channel.push_for(128, std::chrono::milliseconds(1)));
+        std::vector<int> rest;
+        channel.drain(std::back_inserter(rest));
+        assert(128 == rest.size() && 1 == rest.front() && 128 == rest.back());
+        assert(channel.empty());
+        assert(!channel.pop_for(value, std::chrono::milliseconds(1)));
+
+        // producers block on a full channel, consumers on an empty one, and
+        // close() lets the consumers finish what is left
+        Channel<int> small(1, WaitPolicy{100, true});
+        const int per_producer = 20000;
+        std::atomic<long long> total{0};
+        std::vector<std::thread> producers, consumers;
+        for (int t = 0; t < 3; t++)
+            producers.emplace_back([&] {
+                for (int i = 1; i <= per_producer; i++) assert(small.push(i));
+            });
+        for (int t = 0; t < 2; t++)
+            consumers.emplace_back([&] {
+                int v;
+                while (small.pop(v)) total += v;
+            });
+        for (auto& producer : producers) producer.join();
+        small.close();
+        for (auto& consumer : consumers) consumer.join();
+        assert(3LL * per_producer * (per_producer + 1) / 2 == total);
+        assert(!small.push(1));
+        assert(!small.try_push(1));
+        assert(!small.pop(value));
+
+        Channel<std::string> strings(2, WaitPolicy{0, false});
+        std::string word = "word";
+        assert(strings.push(word) && "word" == word);
+        strings.close();
+        assert(!strings.push(std::move(word)) && "word" == word);
+        assert(strings.pop(word) && "word" == word);
+        assert(!strings.pop(word));
+    }
+
+    {
+        EpochDeque<int> events;
+        for (int i = 0; i < 1000; i++) events.push_back(i);
+        auto old_view = events.snapshot();
+        for (int i = 0; i < 600; i++) events.pop_front();
+        for (int i = 1000; i < 1500; i++) events.push_back(i);
+        assert(1000 == old_view.size());
+        assert(0 == old_view[0] && 999 == old_view[999]);
+        int expected = 0;
+        for (int v : old_view) assert(expected++ == v);
+        auto view = events.snapshot();
+        assert(900 == view.size() && 600 == view[0] && 1499 == view[899]);
+        assert(600 == events.front() && 1499 == events.back());
+
+        // chunks popped while a snapshot is alive outlive the pops
+        EpochDeque<std::string> strings;
+        for (int i = 0; i < 100; i++) strings.push_back(std::to_string(i));
+        auto strings_view = strings.snapshot();
+        for (int round = 0; round < 50; round++) {
+            for (int i = 0; i < 100; i++) strings.pop_front();
+            for (int i = 0; i < 100; i++) strings.push_back("x");
+        }
+        assert("0" == strings_view[0] && "99" == strings_view[99]);
+
+        // readers always see a run of consecutive values while the writer
+        // appends and trims
+        EpochDeque<long> stream;
+        std::atomic<bool> done{false};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 3; t++)
+            readers.emplace_back([&] {
+                while (!done) {
+                    auto snap = stream.snapshot();
+                    if (snap.empty()) continue;
+                    long first = snap[0], n = long(snap.size()), sum = 0;
+                    snap.for_each_segment([&](const long* from, const long* to) {
+                        for (; from != to; from++) sum += *from;
+                    });
+                    assert(n * first + n * (n - 1) / 2 == sum);
+                    assert(first + n - 1 == snap[snap.size() - 1]);
+                }
+            });
+        for (long i = 0; i < 300000; i++) {
+            stream.push_back(i);
+            if (stream.size() > 5000) stream.pop_front();
+        }
+        done = true;
+        for (auto& reader : readers) reader.join();
+        assert(5000 == stream.size() && 299999 == stream.back());
+    }
+
+    {
+        Executor executor;
+        AsyncDeque<int> bounded(4);
+        long long consumed = 0;
+        int max_size = 0;
+        auto producer = [&]() -> Job {
+            for (int i = 1; i <= 1000; i++) co_await bounded.push_back(i);
+            co_await bounded.push_back(0);
+        };
+        auto consumer = [&]() -> Job {
+            for (int value; (value = co_await bounded.pop_front()) != 0;) {
+                consumed += value;
+                max_size = std::max(max_size, int(bounded.size()));
+                if (value % 7 == 0) co_await executor.yield();
+            }
+        };
+        executor.spawn(consumer());
+        executor.spawn(producer());
+        executor.run();
+        assert(500500 == consumed);
+        assert(4 == max_size);
+        assert(bounded.empty());
+
+        // a coroutine suspended on one thread is resumed by the thread that
+        // pushes, and keeps running there
+        AsyncDeque<std::string> strings;
+        std::vector<std::string> received;
+        std::thread::id resumed_on;
+        auto reader = [&]() -> Job {
+            for (int i = 0; i < 3; i++) received.push_back(co_await strings.pop_front());
+            resumed_on = std::this_thread::get_id();
+        };
+        executor.spawn(reader());
+        executor.run();
+        assert(received.empty());
+        std::thread writer([&] {
+            for (const char* word : {"a", "b", "c"}) assert(strings.try_push_back(word));
+        });
+        std::thread::id writer_id = writer.get_id();
+        writer.join();
+        assert(3 == received.size() && "c" == received[2]);
+        assert(writer_id == resumed_on);
+
+        std::string word;
+        assert(!strings.try_pop_front(word));
+        AsyncDeque<int> one(1);
+        assert(one.try_push_back(1));
+        assert(!one.try_push_back(2));
+    }
+
+    {
+        ShardedDeque<int> log(4);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; t++)
+            writers.emplace_back([&, t] {
+                for (int i = 0; i < 10000; i++) log.push_back(t * 10000 + i);
+            });
+        for (auto& writer : writers) writer.join();
+        assert(40000 == log.size());
+        std::vector<int> records;
+        log.drain_all(std::back_inserter(records));
+        assert(log.empty() && 40000 == records.size());
+        std::vector<int> last(4, -1);
+        for (int v : records) {
+            assert(last[v / 10000] < v);
+            last[v / 10000] = v;
+        }
+
+        // pushes from two threads interleave; the ordered drain restores
+        // the push order
+        ShardedDeque<std::string, true> ordered(2);
+        auto push_range = [&](int from, int to) {
+            for (int i = from; i < to; i++) ordered.push_back(std::to_string(i));
+        };
+        push_range(0, 100);
+        std::thread([&] { push_range(100, 200); }).join();
+        push_range(200, 300);
+        std::vector<std::string> merged;
+        ordered.drain_all(std::back_inserter(merged));
+        assert(300 == merged.size());
+        for (int i = 0; i < 300; i++) assert(std::to_string(i) == merged[i]);
+        ordered.push_back("again");
+        merged.clear();
+        ordered.drain_all(std::back_inserter(merged));
+        assert(1 == merged.size() && "again" == merged[0]);
+    }
+
     std::cout << "1";
 
     return 0;